@@ -0,0 +1,182 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+#include "clexheaders.h"
+
+#include <stdlib.h>		/* malloc() */
+#include <string.h>		/* strlen() */
+
+#include "util.h"		/* emalloc() */
+
+/*
+ * The ARENA structure (defined in arena.h) is a storage for many
+ * small objects with the same lifetime, e.g. the file panel entries
+ * and their names.
+ *
+ * Objects are never freed individually. arena_reset() discards
+ * all objects at once in constant time, but keeps the memory
+ * for reuse. arena_trim() returns unused memory to the system.
+ *
+ * - to initialize before first use:
+ *     static ARENA arena = ANULL;
+ *     (static and global variables are initialized by default)
+ * - to allocate an object:
+ *     arena_alloc()
+ *       or
+ *     arena_strdup(), arena_wcsdup()
+ * - to discard all objects:
+ *     arena_reset()
+ * - to return the unused memory to the system:
+ *     arena_trim()
+ *
+ * arena functions are not thread-safe; a worker thread may use
+ * arena_tryalloc() with an arena not shared with other threads
+ */
+
+/* this is a tunable parameter */
+#define BLOCK_SIZE	(256 * 1024)	/* large blocks are mmap()-ed by malloc() */
+
+typedef struct arena_block {
+	struct arena_block *next;
+	size_t size;				/* size of data[] */
+	size_t used;				/* used bytes in data[] */
+	union {						/* data aligned for any type */
+		long int l;
+		double d;
+		void *p;
+	} data[1];
+} ARENA_BLOCK;
+
+#define UNIT		sizeof(((ARENA_BLOCK *)0)->data[0])
+#define ROUND(X)	((X + UNIT - 1) / UNIT * UNIT)
+
+/* 'try' = return null if out of memory, see arena_tryalloc() */
+static ARENA_BLOCK *
+block_new(ARENA *pa, size_t size, FLAG try)
+{
+	ARENA_BLOCK *pb;
+
+	if (size < BLOCK_SIZE)
+		size = BLOCK_SIZE;
+	if (!try)
+		pb = emalloc(sizeof(ARENA_BLOCK) + size);
+	else if ((pb = malloc(sizeof(ARENA_BLOCK) + size)) == 0)
+		return 0;
+	pb->next = 0;
+	pb->size = size;
+	pb->used = 0;
+	pa->size += size;
+	return pb;
+}
+
+static void *
+alloc(ARENA *pa, size_t size, FLAG try)
+{
+	void *mem;
+	ARENA_BLOCK *pb;
+
+	size = ROUND(size);
+	if ((pb = pa->cur) == 0 && (pb = pa->first = block_new(pa,size,try)) == 0)
+		return 0;
+	while (pb->used + size > pb->size) {
+		/* blocks after the current one are unused */
+		if (pb->next == 0 && (pb->next = block_new(pa,size,try)) == 0)
+			return 0;
+		pb = pb->next;
+		pb->used = 0;
+	}
+	pa->cur = pb;
+
+	mem = (char *)pb->data + pb->used;
+	pb->used += size;
+	return mem;
+}
+
+void *
+arena_alloc(ARENA *pa, size_t size)
+{
+	return alloc(pa,size,0);
+}
+
+/* like arena_alloc(), but return null instead of exiting if out of memory */
+void *
+arena_tryalloc(ARENA *pa, size_t size)
+{
+	return alloc(pa,size,1);
+}
+
+char *
+arena_strdup(ARENA *pa, const char *str)
+{
+	size_t size;
+
+	size = strlen(str) + 1;
+	return memcpy(arena_alloc(pa,size),str,size);
+}
+
+wchar_t *
+arena_wcsdup(ARENA *pa, const wchar_t *str)
+{
+	size_t size;
+
+	size = (wcslen(str) + 1) * sizeof(wchar_t);
+	return memcpy(arena_alloc(pa,size),str,size);
+}
+
+/* discard all objects */
+void
+arena_reset(ARENA *pa)
+{
+	if ( (pa->cur = pa->first) )
+		pa->first->used = 0;
+}
+
+/* approximate amount of memory in use */
+size_t
+arena_used(const ARENA *pa)
+{
+	size_t used;
+	ARENA_BLOCK *pb;
+
+	if (pa->cur == 0)
+		return 0;
+	for (used = pa->cur->used, pb = pa->first; pb != pa->cur; pb = pb->next)
+		used += pb->size;
+	return used;
+}
+
+/* free unused blocks, but keep at least 'keep' bytes */
+void
+arena_trim(ARENA *pa, size_t keep)
+{
+	size_t size;
+	ARENA_BLOCK *pb, *next, **ppb;
+
+	size = 0;
+	ppb = &pa->first;
+	/* blocks up to the current one are in use */
+	if (pa->cur)
+		for (; *ppb != pa->cur->next; ppb = &(*ppb)->next)
+			size += (*ppb)->size;
+	/* unused blocks */
+	for (; *ppb && size + (*ppb)->size <= keep; ppb = &(*ppb)->next)
+		size += (*ppb)->size;
+
+	for (pb = *ppb; pb; pb = next) {
+		next = pb->next;
+		pa->size -= pb->size;
+		efree(pb);
+	}
+	*ppb = 0;
+}
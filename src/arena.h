@@ -0,0 +1,17 @@
+struct arena_block;
+
+typedef struct {
+	struct arena_block *first;	/* list of memory blocks */
+	struct arena_block *cur;	/* block being filled */
+	size_t size;				/* total size of all blocks */
+} ARENA;
+
+#define ANULL	{0,0,0}
+
+extern void *arena_alloc(ARENA *, size_t);
+extern void *arena_tryalloc(ARENA *, size_t);
+extern char *arena_strdup(ARENA *, const char *);
+extern wchar_t *arena_wcsdup(ARENA *, const wchar_t *);
+extern void arena_reset(ARENA *);
+extern size_t arena_used(const ARENA *);
+extern void arena_trim(ARENA *, size_t);
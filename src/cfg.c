@@ -34,6 +34,7 @@
 #include "mbwstring.h"		/* convert2w() */
 #include "mouse.h"			/* mouse_reconfig() */
 #include "panel.h"			/* cx_pan_home() */
+#include "workers.h"		/* workers_reconfig() */
 #include "xterm_title.h"	/* xterm_title_reconfig() */
 
 #define CFG_FILESIZE_LIMIT 2000	/* config file size limit (in bytes) */
@@ -92,7 +93,8 @@ static CNUM table_numeric[] = {
 	{ CFG_D_SIZE,		L"AUTO",	10,    0, 200 },
 	{ CFG_H_SIZE,		0,			10,   60, 200 },
 	{ CFG_MOUSE_SCROLL,	0,			1,     3, 8   },
-	{ CFG_DOUBLE_CLICK,	0,			200, 400, 800 }
+	{ CFG_DOUBLE_CLICK,	0,			200, 400, 800 },
+	{ CFG_WORKERS,		0,			1,     4, 64  }
 };
 
 typedef struct {
@@ -184,6 +186,8 @@ static struct {
 		L"Advanced: Additional filename chars to be quoted, see help" },
 	{ CFG_TIME_DATE,	"TIME_DATE",
 		L"Appearance: Time and date display mode" },
+	{ CFG_WORKERS,		"WORKERS",
+		L"Advanced: Number of threads reading file information" },
 	{ CFG_XTERM_TITLE,	"XTERM_TITLE",
 		L"Appearance: Change the X terminal window title" }
 };
@@ -690,6 +694,8 @@ apply_changes(void)
 		dir_reconfig();
 	if (config[CFG_H_SIZE].changed)
 		hist_reconfig();
+	if (config[CFG_WORKERS].changed)
+		workers_reconfig();
 
 	if (reread) {
 		list_directory();
@@ -58,7 +58,7 @@ enum MODE_TYPE {
 	/* regular modes */
 	MODE_BM, MODE_BM_EDIT0, MODE_BM_EDIT1, MODE_BM_EDIT2,
 	MODE_CFG, MODE_CFG_EDIT_NUM, MODE_CFG_EDIT_TXT, MODE_CFG_MENU,
-	MODE_COMPL, MODE_CMP, MODE_CMP_SUM, MODE_DESELECT,
+	MODE_COMPL, MODE_CMP, MODE_CMP_SUM, MODE_CMP_TREE, MODE_DESELECT,
 	MODE_DIR, MODE_DIR_SPLIT, MODE_FILE, MODE_FOPT, MODE_GROUP, MODE_HELP,
 	MODE_HIST, MODE_INSCHAR, MODE_LOG, MODE_MAINMENU, MODE_NOTIF, MODE_PASTE,
 	MODE_PREVIEW, MODE_RENAME, MODE_SELECT, MODE_SORT, MODE_USER,
@@ -92,6 +92,7 @@ typedef struct {
 	int dir1end, dir2start;	/* columns of the directory names in the file panel title */
 	wchar_t *layout_panel;	/* layout: file panel part */
 	wchar_t *layout_line;	/* layout: info line part */
+	FLAG layout_info;		/* layout: file panel part shows file information */
 } DISP_DATA;
 
 /* info about language/encoding */
@@ -119,6 +120,7 @@ typedef struct {
 	const char *file_cfg;		/* configuration file */
 	const char *file_opt;		/* options file */
 	const char *file_bm;		/* bookmarks file */
+	const char *file_hc;		/* hash cache file */
 	CODE shelltype;				/* one of SHELL_XXX */
 	FLAG isroot;				/* effective uid is 0(root) */
 	FLAG nowrite;				/* do not write config/options/bookmark file */
@@ -222,7 +224,7 @@ typedef struct {
 /* panel types */
 enum PANEL_TYPE {
 	PANEL_TYPE_BM = 0, PANEL_TYPE_CFG, PANEL_TYPE_CFG_MENU, PANEL_TYPE_CMP, PANEL_TYPE_CMP_SUM,
-	PANEL_TYPE_COMPL, PANEL_TYPE_DIR, PANEL_TYPE_DIR_SPLIT, PANEL_TYPE_FILE,
+	PANEL_TYPE_CMP_TREE, PANEL_TYPE_COMPL, PANEL_TYPE_DIR, PANEL_TYPE_DIR_SPLIT, PANEL_TYPE_FILE,
 	PANEL_TYPE_FOPT, PANEL_TYPE_GROUP, PANEL_TYPE_HELP, PANEL_TYPE_HIST,
 	PANEL_TYPE_LOG, PANEL_TYPE_MAINMENU, PANEL_TYPE_NOTIF, PANEL_TYPE_PASTE,
 	PANEL_TYPE_PREVIEW, PANEL_TYPE_SORT, PANEL_TYPE_USER
@@ -304,32 +306,64 @@ typedef struct {
 #define FE_NAME_STR		17		/* root */
 #define FE_OWNER_STR	(2 * FE_NAME_STR)	/* root:mail */
 
+/*
+ * rarely needed parts of the file description, allocated only
+ * when required, see file_extra() in list.c
+ *
+ * FILE_ENTRies, FILE_EXTRAs and all the strings they point to
+ * are stored in the file panel's arena
+ */
+typedef struct {
+	const wchar_t *filew;	/* file name - converted to wchar for the screen output */
+	const wchar_t *filelc;	/* lowercase filew for the filter or null, see file_namelc() */
+	unsigned long charmask;	/* match_charmask() of filelc */
+	const char *link;		/* where the symbolic link points to */
+	const wchar_t *linkw;	/* ditto */
+	dev_t devnum;			/* major/minor numbers (devices only) */
+	/* note: these members are used only when the file panel layout requires them */
+	time_t atime;			/* last access */
+	time_t ctime;			/* last inode change */
+	nlink_t nlink;			/* number of links */
+} FILE_EXTRA;
+
 /*
  * file description - exhausting, isn't it ?
  * we allocate many of these, bitfields save memory
+ *
+ * Only data needed for sorting and filtering is stored here,
+ * the rest is in FILE_EXTRA. Use file_namew() to get the
+ * wide character name.
  */
 typedef struct {
-	SDSTRING  file;			/* file name - as it is */
-	SDSTRINGW filew;		/* file name - converted to wchar for the screen output */
-	USTRING link;			/* where the symbolic link points to */
-	USTRINGW linkw;			/* ditto */
+	const char *file;		/* file name - as it is */
 	const char *extension;	/* file name extension (suffix) */
+	const char *collkey;	/* collation key or null, see sort_keys() */
+	FILE_EXTRA *extra;		/* null if not allocated yet */
 	time_t mtime;			/* last file modification */
 	off_t size;				/* file size */
-	dev_t devnum;			/* major/minor numbers (devices only) */
-	CODE file_type;			/* one of FT_XXX */
 	uid_t uid, gid;			/* owner and group */
 	short int mode12;		/* file mode - low 12 bits */
+	CODE file_type;			/* one of FT_XXX */
 	unsigned int select:1;		/* flag: this entry is selected */
-	unsigned int symlink:1;		/* flag: it is a symbolic link */
+	unsigned int symlink:1;		/* flag: it is a symbolic link, see extra->link */
 	unsigned int dotdir:2;		/* . (1) or .. (2) directory */
 	unsigned int fmatch:1;		/* flag: matches the filter */
+	unsigned int gone:1;		/* flag: deleted while being listed (list.c only) */
+	unsigned int pending:1;		/* flag: file information not read yet, file_type
+								   is only approximate and all other data is blank */
+	unsigned int namew:1;		/* flag: extra->filew is valid, see file_namew() */
+	unsigned int keynum:1;		/* flag: collkey is for the SORT_NAME_NUM order */
+	unsigned int grank:3;		/* file type group rank (sort.c only) */
 	/*
 	 * note: the structure members below are used
 	 * only when the file panel layout requires them
 	 */
 	unsigned int normal_mode:1;	/* file mode same as "normal" file */
 	unsigned int links:1;		/* has multiple hard links */
+} FILE_ENTRY;
+
+/* FILE_ENTRY data formatted for the output, see file_fields() */
+typedef struct {
 	wchar_t atime_str[FE_TIME_STR];	/* access time */
 	wchar_t ctime_str[FE_TIME_STR];	/* inode change time */
 	wchar_t mtime_str[FE_TIME_STR];	/* file modification time */
@@ -338,15 +372,26 @@ typedef struct {
 	char links_str[FE_LINKS_STR];	/* number of links */
 	char mode_str[FE_MODE_STR];		/* file mode - octal number */
 	char size_str[FE_SIZE_DEV_STR];	/* file size or dev major/minor */
-} FILE_ENTRY;
+} FILE_FIELDS;
 
 /*
  * When a filter or the selection panel is activated or when panels are switched, the
  * file panel will be refreshed if the contents are older than PANEL_EXPTIME seconds.
  * This time is not configurable because it would confuse a typical user.
+ * Panels with a watched directory (see watch.c) are updated with the reported
+ * changes, but they are read completely again after PANEL_EXPTIME seconds,
+ * because not all changes are reported.
  */
 #define PANEL_EXPTIME 60
 
+/* a saved result of sort_files(), see sort.c */
+typedef struct {
+	unsigned int gen;		/* 'list_gen' of the saved list, 0 = nothing saved */
+	int cnt;				/* number of saved entries */
+	int alloc;				/* allocated entries in 'files' */
+	FILE_ENTRY **files;		/* 'all_files' sorted in one order and grouping */
+} SORT_SAVED;
+
 typedef struct ppanel_file {
 	PANEL_DESC *pd;
 	USTRING dir;			/* working directory */
@@ -354,11 +399,22 @@ typedef struct ppanel_file {
 	struct ppanel_file *other;	/* primary <--> secondary panel ptr */
 	time_t timestamp;		/* when was the directory listed */
 	FLAG expired;			/* expiration: panel needs to be re-read */
-	FLAG filtype;			/* filter type: 0 = substring, 1 = pattern */
+	FLAG filtype;			/* filter type: 0 = substring, 1 = pattern, 2 = regex, 3 = fuzzy */
 	CODE order;				/* sort order: one of SORT_XXX */
 	CODE group;				/* group by type: one of GROUP_XXX */
 	CODE hide;				/* ignore hidden .files: one of HIDE_XXX */
 	FLAG hidden;			/* there exist hidden .files not shown */
+	dev_t dirdev;			/* filesystem device of 'dir' */
+	ARENA arena;			/* storage for all_files entries */
+	ARENA arena_old;		/* spare storage, see directory_read() */
+	int pending;			/* number of FILE_ENTRies with the 'pending' flag */
+	int watch_fd;			/* inotify instance or -1, see watch.c */
+	int watch_wd;			/* watch descriptor of 'dir' or -1 */
+	time_t read_time;		/* when was the directory read completely */
+	unsigned int list_gen;	/* incremented on every change of 'all_files' except sorting */
+	SORT_SAVED *saved;		/* SORT_TOTAL_ x GROUP_TOTAL_ sort results or null */
+	int partial;			/* only all_files[0 .. partial-1] are sorted (0 = all),
+							   see sort_finish() */
 	/* unfiltered data - access only in list.c and sort.c */
 	int all_cnt;			/* number of all files */
 	int all_alloc;			/* allocated FILE_ENTRies in 'all_files' below */
@@ -430,6 +486,8 @@ enum SORT_TYPE {
 	SORT_SIZE_REV, SORT_TIME, SORT_TIME_REV, SORT_EMAN,
 	SORT_TOTAL_
 };
+/* sort orders requiring the file information, not only the name */
+#define SORT_NEEDS_INFO(X)	((X) >= SORT_SIZE && (X) <= SORT_TIME_REV)
 
 enum GROUP_TYPE {
 	GROUP_NONE = 0, GROUP_DSP, GROUP_DBCOP,
@@ -459,6 +517,7 @@ typedef struct {
 	const char *name;		/* directory name */
 	const wchar_t *namew;	/* directory name for display */
 	int shlen;				/* length of the repeating 'namew' part */
+	int score;				/* fuzzy filter match score */
 } DIR_ENTRY;
 
 typedef struct {
@@ -484,7 +543,7 @@ enum CFG_TYPE {
 	/* mouse */
 	CFG_MOUSE, CFG_MOUSE_SCROLL, CFG_DOUBLE_CLICK,
 	/* other */
-	CFG_QUOTE, CFG_C_SIZE, CFG_D_SIZE, CFG_H_SIZE,
+	CFG_QUOTE, CFG_C_SIZE, CFG_D_SIZE, CFG_H_SIZE, CFG_WORKERS,
 	/* total count*/
 	CFG_TOTAL_
 };
@@ -563,7 +622,7 @@ typedef struct {
 /* - must correspond with panel_fopt initializer in start.c */
 /* - fopt_saveopt(), fopt_restoreopt() must remain backward compatible */
 enum FOPT_TYPE {
-	FOPT_IC, FOPT_ALL, FOPT_SHOWDIR,
+	FOPT_IC, FOPT_ALL, FOPT_SHOWDIR, FOPT_REGEX, FOPT_FUZZY,
 	FOPT_TOTAL_
 };
 
@@ -579,7 +638,7 @@ typedef struct {
 /* - must correspond with panel_cmp initializer in start.c */
 /* - cmp_saveopt(), cmp_restoreopt() must remain backward compatible */
 enum CMP_TYPE {
-	CMP_REGULAR, CMP_SIZE, CMP_MODE, CMP_OWNER, CMP_DATA,
+	CMP_REGULAR, CMP_SIZE, CMP_MODE, CMP_OWNER, CMP_DATA, CMP_RENAMED, CMP_RECURSIVE,
 	CMP_TOTAL_
 };
 
@@ -589,6 +648,45 @@ typedef struct {
 } PANEL_CMP;
 #define COPT(X)		(panel_cmp.option[X])
 
+/* differences found by the recursive comparison */
+/* - must correspond with descriptions in draw_line_cmp_tree() in inout.c */
+enum DIFF_TYPE {
+	DIFF_ONLY1, DIFF_ONLY2, DIFF_TYPE, DIFF_SIZE, DIFF_MODE, DIFF_OWNER, DIFF_DATA, DIFF_ERROR
+};
+
+typedef struct {
+	CODE reason;			/* one of DIFF_XXX */
+	const char *path;		/* pathname relative to the panel directories */
+	const wchar_t *pathw;	/* the same as a wide string */
+} CMP_DIFF;
+
+typedef struct {
+	PANEL_DESC *pd;
+	CMP_DIFF *diff;			/* list of differences */
+	int alloc;				/* allocated entries in 'diff' */
+	ARENA arena;			/* memory for the pathnames */
+	int dirs, errors;		/* statistics */
+} PANEL_CMP_TREE;
+
+/* file identification in the hash cache, see hashcache.c */
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime, ctime;
+	long mtime_ns, ctime_ns;	/* nanoseconds or 0 if not supported */
+} HC_KEY;
+
+typedef struct {
+	uint64_t h1, h2;
+} HC_DIGEST;
+
+/* state of an incremental hash computation */
+typedef struct {
+	HC_DIGEST digest;
+	uint64_t len;
+} HC_STATE;
+
 /********************************************************************/
 
 #define LOG_LINES		50
@@ -630,7 +728,7 @@ typedef struct {
 typedef struct {
 	PANEL_DESC *pd;
 	int realcnt;				/* lines with real data, used for --end-- mark */
-	wchar_t *title;				/* name of the file */
+	const wchar_t *title;		/* name of the file */
 	USTRINGW line[PREVIEW_LINES];
 } PANEL_PREVIEW;
 
@@ -665,6 +763,9 @@ typedef struct {
 typedef struct {
 	PANEL_DESC *pd;
 	int nonreg1, nonreg2, errors, names, equal;
+	FLAG renames;				/* rename detection was performed */
+	int renamed1, renamed2;		/* unique files with data equal to a unique file in the other panel */
+	int hc_lookups, hc_hits;	/* hash cache statistics */
 } PANEL_CMP_SUM;
 
 /********************************************************************/
@@ -693,6 +794,7 @@ extern PANEL_BM panel_bm;
 extern PANEL_CMP panel_cmp;
 extern PANEL_COMPL panel_compl;
 extern PANEL_CMP_SUM panel_cmp_sum;
+extern PANEL_CMP_TREE panel_cmp_tree;
 extern PANEL_DIR panel_dir;	
 extern PANEL_DIR_SPLIT panel_dir_split;	
 extern PANEL_FOPT panel_fopt;
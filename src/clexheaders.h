@@ -1,14 +1,16 @@
 #if defined(__APPLE__)
 # define _XOPEN_SOURCE_EXTENDED
 #elif !defined(__FreeBSD__)
-# define _XOPEN_SOURCE 600
+# define _XOPEN_SOURCE 700
 #endif
 
 #include "../config.h"
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <wchar.h>
 #include "sdstring.h"
 #include "ustring.h"
+#include "arena.h"
 
 #include "clex.h"
@@ -16,23 +16,27 @@
 
 #include "clexheaders.h"
 
-#include <sys/stat.h>	/* stat() */
+#include <sys/stat.h>	/* fstatat() */
+#include <dirent.h>		/* readdir() */
 #include <errno.h>		/* errno */
-#include <fcntl.h>		/* open() */
+#include <fcntl.h>		/* openat(), posix_fadvise() */
 #include <stdarg.h>		/* log.h */
 #include <stdlib.h>		/* qsort() */
 #include <string.h>		/* strcmp() */
-#include <unistd.h>		/* close() */
+#include <unistd.h>		/* close(), pread(), lseek() */
 
 #include "select.h"
 
+#include "hashcache.h"	/* hc_lookup() */
 #include "inout.h"		/* win_waitmsg() */
 #include "list.h"		/* list_both_directories() */
 #include "log.h"		/* msgout() */
+#include "mbwstring.h"	/* convert2w() */
 #include "opt.h"		/* opt_changed() */
 #include "panel.h"		/* pan_adjust() */
 #include "signals.h"	/* signal_ctrlc_on() */
 #include "util.h"		/* pathname_join() */
+#include "workers.h"	/* work_submit() */
 
 int
 cmp_prepare(void)
@@ -55,7 +59,8 @@ int
 cmp_summary_prepare(void)
 {
 	panel_cmp_sum.pd->top = panel_cmp_sum.pd->curs = panel_cmp_sum.pd->min;
-	panel_cmp_sum.pd->cnt = panel_cmp_sum.errors ? 6 : 5;
+	panel_cmp_sum.pd->cnt = 5 + (panel_cmp_sum.errors != 0) + (panel_cmp_sum.hc_lookups != 0)
+	  + panel_cmp_sum.renames;
 	panel = panel_cmp_sum.pd;
 	textline = 0;
 
@@ -65,6 +70,24 @@ cmp_summary_prepare(void)
 	return 0;
 }
 
+int
+cmp_tree_prepare(void)
+{
+	static wchar_t msg[80];
+
+	panel_cmp_tree.pd->top = panel_cmp_tree.pd->min;
+	panel_cmp_tree.pd->curs = panel_cmp_tree.pd->cnt ? 0 : panel_cmp_tree.pd->min;
+	panel = panel_cmp_tree.pd;
+	textline = 0;
+
+	swprintf(msg,ARRAY_SIZE(msg),L"%d difference(s) in %d directories compared, %ls",
+	  panel_cmp_tree.pd->cnt,panel_cmp_tree.dirs,panel_cmp_tree.errors
+	  ? L"error messages can be found in the log (alt-L)" : L"#1 = this panel");
+	win_sethelp(HELPMSG_OVERRIDE,msg);
+
+	return 0;
+}
+
 /* write options to a string */
 const char *
 cmp_saveopt(void)
@@ -100,89 +123,1274 @@ cmp_restoreopt(const char *opt)
 }
 
 static int
-qcmp(const void *e1, const void *e2)
+qcmp_size(const void *e1, const void *e2)
 {
-	return strcmp( /* not strcoll() */
-	  SDSTR((*(FILE_ENTRY **)e1)->file),
-	  SDSTR((*(FILE_ENTRY **)e2)->file));
+	off_t s1, s2;
+
+	s1 = (*(FILE_ENTRY **)e1)->size;
+	s2 = (*(FILE_ENTRY **)e2)->size;
+	return s1 < s2 ? -1 : s1 > s2;
 }
 
-#define CMP_BUF_STR	16384
+/*
+ * The data of file pairs are compared by the worker threads. The jobs
+ * are collected in two batches: while the jobs of one batch are being
+ * executed, the main thread continues with matching the names and fills
+ * the other batch. A job only reads the files and records the result,
+ * the main thread evaluates it (messages, selection, summary).
+ */
+#define CMP_BUF_STR	(256 * 1024)
+#define CMP_JOBS	8		/* jobs in a batch */
+#define CMP_ALIGN	4096
+
+enum CMP_ERROR { CMP_ERR_NONE, CMP_ERR_OPEN, CMP_ERR_NOTREG, CMP_ERR_READ };
+
+/* a unique file for the rename detection, see cmp_unique() */
+typedef struct {
+	FILE_ENTRY *pfe;
+	int panel;				/* 1 or 2 */
+	FLAG hashed;			/* 'digest' is valid */
+	HC_DIGEST digest;
+} UNIQUE_FILE;
+
+typedef struct {
+	FILE_ENTRY *pfe1, *pfe2;
+	FLAG renamed;			/* the names differ, see cmp_renamed() */
+	UNIQUE_FILE *puf;		/* not null: hash this file only, see file_hash() */
+	USTRING file2;			/* the pathname of the second file */
+	char *buff1, *buff2;	/* CMP_BUF_STR bytes each */
+	int result;				/* -1 error, 0 compare ok, +1 compare failed */
+	enum CMP_ERROR error;	/* error details: */
+	int errfile;			/* 1 or 2 */
+	int errcode;			/* errno */
+	/* hash cache: */
+	HC_KEY key1, key2;
+	HC_DIGEST digest1, digest2;
+	int lookups;			/* number of cache lookups: 0 or 2 */
+	FLAG hit1, hit2;		/* digestN was found in the cache */
+	FLAG new1, new2;		/* digestN was computed and should be cached */
+} CMP_JOB;
+
+typedef struct {
+	WORK_GROUP group;
+	CMP_JOB job[CMP_JOBS];
+	int cnt;
+} CMP_BATCH;
+
+static CMP_BATCH cmp_batch[2];
+static int cmp_fill;		/* the batch being filled */
+
+static char *
+cmp_buffer(void)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+	void *buff;
+
+	if (posix_memalign(&buff,CMP_ALIGN,CMP_BUF_STR) == 0)
+		return buff;
+#endif
+	return emalloc(CMP_BUF_STR);
+}
 
-/* return value: -1 error, 0 compare ok, +1 compare failed */
 static int
-data_cmp(int fd1, const char *file1, int fd2, const char *file2)
+cmp_fail(CMP_JOB *pj, enum CMP_ERROR error, int errfile)
+{
+	pj->error = error;
+	pj->errfile = errfile;
+	pj->errcode = errno;
+	return -1;
+}
+
+/* compute the hash of the whole file, return -1 on error */
+static int
+data_hash(CMP_JOB *pj, int fd, char *buff, int errfile, off_t filesize, HC_DIGEST *pd)
 {
-	struct stat st1, st2;
-	static char buff1[CMP_BUF_STR], buff2[CMP_BUF_STR];
-	off_t filesize;
 	size_t chunksize;
+	HC_STATE hs;
 
-	if (fstat(fd1,&st1) < 0 || !S_ISREG(st1.st_mode)) {
-		msgout(MSG_NOTICE,"COMPARE: File \"./%s\" is not a regular file",file1);
-		return -1;
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+	hc_hash_init(&hs);
+	while (filesize > 0) {
+		chunksize = filesize > CMP_BUF_STR ? CMP_BUF_STR : filesize;
+		if (ctrlc_flag)
+			return -1;
+		if (read_fd(fd,buff,chunksize) != chunksize)
+			return cmp_fail(pj,CMP_ERR_READ,errfile);
+		hc_hash_update(&hs,buff,chunksize);
+		filesize -= chunksize;
 	}
-	if (fstat(fd2,&st2) < 0 || !S_ISREG(st2.st_mode)) {
-		msgout(MSG_NOTICE,"COMPARE: File \"%s\" is not a regular file",file2);
-		return -1;
+	hc_hash_final(&hs,pd);
+	return 0;
+}
+
+static int
+digest_cmp(const HC_DIGEST *pd1, const HC_DIGEST *pd2)
+{
+	return pd1->h1 != pd2->h1 || pd1->h2 != pd2->h2;
+}
+
+/* read() at the given offset, the same return value as read_fd() */
+static ssize_t
+pread_fd(int fd, char *buff, size_t bytes, off_t offset)
+{
+	size_t total;
+	ssize_t rd;
+
+	for (total = 0; bytes > 0; total += rd, bytes -= rd) {
+		rd = pread(fd,buff + total,bytes,offset + total);
+		if (rd == -1)	/* error */
+			return -1;
+		if (rd == 0)	/* EOF */
+			break;
+	}
+	return total;
+}
+
+/* compare 'size' bytes at the given offset, return value as data_cmp() */
+static int
+range_cmp(CMP_JOB *pj, int fd1, int fd2, off_t offset, off_t size)
+{
+	size_t chunksize;
+
+	while (size > 0) {
+		chunksize = size > CMP_BUF_STR ? CMP_BUF_STR : size;
+		if (ctrlc_flag)
+			return -1;
+		if (pread_fd(fd1,pj->buff1,chunksize,offset) != chunksize)
+			return cmp_fail(pj,CMP_ERR_READ,1);
+		if (pread_fd(fd2,pj->buff2,chunksize,offset) != chunksize)
+			return cmp_fail(pj,CMP_ERR_READ,2);
+		if (memcmp(pj->buff1,pj->buff2,chunksize) != 0)
+			return 1;
+		offset += chunksize;
+		size -= chunksize;
+	}
+	return 0;
+}
+
+/*
+ * Large files with equal size often differ near the end (appended logs)
+ * or in many places (rebuilt binaries). Before reading them sequentially,
+ * the last block and a few blocks spread over the file are compared.
+ * Return value as data_cmp(), 0 means the samples are equal.
+ */
+#define CMP_SAMPLE		(16 * 1024)			/* size of one sample */
+#define CMP_SAMPLES		3					/* samples besides the last block */
+#define CMP_SAMPLE_MIN	(4 * CMP_BUF_STR)	/* smaller files are not sampled */
+
+static int
+sample_cmp(CMP_JOB *pj, int fd1, int fd2, off_t filesize)
+{
+	int i, result;
+	off_t offset;
+
+	if ((result = range_cmp(pj,fd1,fd2,filesize - CMP_SAMPLE,CMP_SAMPLE)) != 0)
+		return result;
+	for (i = 1; i <= CMP_SAMPLES; i++) {
+		offset = filesize / (CMP_SAMPLES + 1) * i;
+		offset -= offset % CMP_SAMPLE;
+		if ((result = range_cmp(pj,fd1,fd2,offset,CMP_SAMPLE)) != 0)
+			return result;
 	}
+	return 0;
+}
+
+#ifdef SEEK_DATA
+/* a file occupying less disk space than its size has holes */
+#define SPARSE(ST)	((ST).st_blocks < (ST).st_size / 512)
+
+/*
+ * find where the current data extent or hole ends,
+ * 'hole' is set if the position 'pos' is in a hole
+ */
+static off_t
+extent_end(int fd, off_t pos, off_t filesize, FLAG *hole)
+{
+	off_t next;
+
+	*hole = 0;
+	if ((next = lseek(fd,pos,SEEK_DATA)) < 0) {
+		if (errno != ENXIO)
+			/* SEEK_DATA not supported, everything is data */
+			return filesize;
+		/* a hole up to the end of file */
+		next = filesize;
+	}
+	if (next > pos) {
+		*hole = 1;
+		return next > filesize ? filesize : next;
+	}
+	next = lseek(fd,pos,SEEK_HOLE);
+	/* the file could be modified meanwhile, make sure to advance */
+	return next <= pos || next > filesize ? filesize : next;
+}
+
+/*
+ * compare files with holes, a range being a hole in both files is not
+ * read at all; the hash is not computed, because the data is not read
+ */
+static int
+sparse_cmp(CMP_JOB *pj, int fd1, int fd2, off_t filesize)
+{
+	int result;
+	off_t pos, end1, end2;
+	FLAG hole1, hole2;
+
+	for (pos = 0; pos < filesize; pos = end1) {
+		end1 = extent_end(fd1,pos,filesize,&hole1);
+		end2 = extent_end(fd2,pos,filesize,&hole2);
+		if (end2 < end1)
+			end1 = end2;
+		if (hole1 && hole2)
+			/* zeroes in both files */
+			continue;
+		if ((result = range_cmp(pj,fd1,fd2,pos,end1 - pos)) != 0)
+			return result;
+	}
+	return 0;
+}
+#endif
+
+/*
+ * return value: -1 error, 0 compare ok, +1 compare failed
+ *
+ * A file with a valid hash in the hash cache is not read at all.
+ * Files read completely are hashed and the new hashes are recorded
+ * in the job for the cache. Files with different names have equal
+ * hashes already (see cmp_unique()), their data is always compared.
+ */
+static int
+data_cmp(CMP_JOB *pj, int fd1, int fd2)
+{
+	int result;
+	struct stat st1, st2;
+	off_t filesize;
+	size_t chunksize;
+	HC_STATE hs;
+
+	if (fstat(fd1,&st1) < 0 || !S_ISREG(st1.st_mode))
+		return cmp_fail(pj,CMP_ERR_NOTREG,1);
+	if (fstat(fd2,&st2) < 0 || !S_ISREG(st2.st_mode))
+		return cmp_fail(pj,CMP_ERR_NOTREG,2);
 	if (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino)
 		/* same file */
 		return 0;
 	if ((filesize = st1.st_size) != st2.st_size)
 		return 1;
+	if (filesize == 0)
+		return 0;
+	if (pj->renamed)
+		goto compare;
+
+	hc_key(&pj->key1,&st1);
+	hc_key(&pj->key2,&st2);
+	pj->lookups = 2;
+	pj->hit1 = hc_lookup(&pj->key1,&pj->digest1);
+	pj->hit2 = hc_lookup(&pj->key2,&pj->digest2);
+	if (pj->hit1 && pj->hit2)
+		return digest_cmp(&pj->digest1,&pj->digest2);
+	if (pj->hit1) {
+		if (data_hash(pj,fd2,pj->buff2,2,filesize,&pj->digest2) < 0)
+			return -1;
+		pj->new2 = 1;
+		return digest_cmp(&pj->digest1,&pj->digest2);
+	}
+	if (pj->hit2) {
+		if (data_hash(pj,fd1,pj->buff1,1,filesize,&pj->digest1) < 0)
+			return -1;
+		pj->new1 = 1;
+		return digest_cmp(&pj->digest1,&pj->digest2);
+	}
 
+compare:
+	/* quick reject */
+	if (filesize >= CMP_SAMPLE_MIN && (result = sample_cmp(pj,fd1,fd2,filesize)) != 0)
+		return result;
+#ifdef SEEK_DATA
+	if (filesize >= CMP_SAMPLE_MIN && (SPARSE(st1) || SPARSE(st2)))
+		return sparse_cmp(pj,fd1,fd2,filesize);
+#endif
+
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd1,0,0,POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd2,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+	hc_hash_init(&hs);
 	while (filesize > 0) {
 		chunksize = filesize > CMP_BUF_STR ? CMP_BUF_STR : filesize;
 		if (ctrlc_flag)
 			return -1;
-		if (read_fd(fd1,buff1,chunksize) != chunksize) {
-			msgout(MSG_NOTICE,"COMPARE: Cannot read from \"./%s\" (%s)",file1,strerror(errno));
-			return -1;
-		}
-		if (read_fd(fd2,buff2,chunksize) != chunksize) {
-			msgout(MSG_NOTICE,"COMPARE: Cannot read from \"%s\" (%s)",file2,strerror(errno));
-			return -1;
-		}
-		if (memcmp(buff1,buff2,chunksize) != 0)
+		if (read_fd(fd1,pj->buff1,chunksize) != chunksize)
+			return cmp_fail(pj,CMP_ERR_READ,1);
+		if (read_fd(fd2,pj->buff2,chunksize) != chunksize)
+			return cmp_fail(pj,CMP_ERR_READ,2);
+		if (memcmp(pj->buff1,pj->buff2,chunksize) != 0)
 			return 1;
+		hc_hash_update(&hs,pj->buff1,chunksize);
 		filesize -= chunksize;
 	}
+	/* equal data, equal hashes */
+	hc_hash_final(&hs,&pj->digest1);
+	pj->digest2 = pj->digest1;		/* struct copy */
+	pj->new1 = pj->new2 = 1;
 
 	return 0;
 }
 
-/* return value: -1 error, 0 compare ok, +1 compare failed */
+/*
+ * compare the data of two files, the names are relative to the directory
+ * descriptors (AT_FDCWD = current working directory)
+ */
 static int
-file_cmp(const char *file1, const char *file2)
+pair_cmp(CMP_JOB *pj, int dfd1, const char *file1, int dfd2, const char *file2)
 {
-	int cmp, fd1, fd2;
+	int fd1, fd2, result;
 
-	fd1 = open(file1,O_RDONLY | O_NONBLOCK);
-	if (fd1 < 0) {
-		msgout(MSG_NOTICE,"COMPARE: Cannot open \"./%s\" (%s)",file1,strerror(errno));
-		return -1;
-	}
-	fd2 = open(file2,O_RDONLY | O_NONBLOCK);
+	pj->error = CMP_ERR_NONE;
+	pj->lookups = 0;
+	pj->hit1 = pj->hit2 = pj->new1 = pj->new2 = 0;
+	fd1 = openat(dfd1,file1,O_RDONLY | O_NONBLOCK);
+	if (fd1 < 0)
+		return cmp_fail(pj,CMP_ERR_OPEN,1);
+	fd2 = openat(dfd2,file2,O_RDONLY | O_NONBLOCK);
 	if (fd2 < 0) {
-		msgout(MSG_NOTICE,"COMPARE: Cannot open \"%s\" (%s)",file2,strerror(errno));
+		result = cmp_fail(pj,CMP_ERR_OPEN,2);
 		close(fd1);
-		return -1;
+		return result;
 	}
-	cmp = data_cmp(fd1,file1,fd2,file2);
+	result = data_cmp(pj,fd1,fd2);
 	close(fd1);
 	close(fd2);
-	return cmp;
+	return result;
 }
 
+/* job function: compare the data of one pair */
 static void
-cmp_directories(void)
+file_cmp(void *arg)
 {
-	int min, med, max, cmp, i, j, cnt1, selcnt1, selcnt2;
+	CMP_JOB *pj;
+
+	pj = arg;
+	pj->result = pair_cmp(pj,AT_FDCWD,pj->pfe1->file,AT_FDCWD,USTR(pj->file2));
+}
+
+/* job function: hash one file for the rename detection */
+static void
+file_hash(void *arg)
+{
+	int fd;
+	struct stat st;
+	CMP_JOB *pj;
+
+	pj = arg;
+	pj->error = CMP_ERR_NONE;
+	pj->lookups = 0;
+	pj->hit1 = pj->hit2 = pj->new1 = pj->new2 = 0;
+	if ((fd = open(USTR(pj->file2),O_RDONLY | O_NONBLOCK)) < 0) {
+		pj->result = cmp_fail(pj,CMP_ERR_OPEN,pj->puf->panel);
+		return;
+	}
+	if (fstat(fd,&st) < 0 || !S_ISREG(st.st_mode))
+		pj->result = cmp_fail(pj,CMP_ERR_NOTREG,pj->puf->panel);
+	else {
+		hc_key(&pj->key1,&st);
+		pj->lookups = 1;
+		if ( (pj->hit1 = hc_lookup(&pj->key1,&pj->digest1)) )
+			pj->result = 0;
+		else if ((pj->result = data_hash(pj,fd,pj->buff1,pj->puf->panel,st.st_size,&pj->digest1)) == 0)
+			pj->new1 = 1;
+	}
+	close(fd);
+}
+
+/* pair of matching files found */
+static void
+cmp_equal(FILE_ENTRY *pfe1, FILE_ENTRY *pfe2)
+{
+	pfe1->select = 0;
+	pfe2->select = 0;
+	panel_cmp_sum.equal++;
+}
+
+/* pair of unique files with equal data found, a file may belong to several such pairs */
+static void
+cmp_renamed(FILE_ENTRY *pfe1, FILE_ENTRY *pfe2)
+{
+	if (pfe1->select) {
+		pfe1->select = 0;
+		panel_cmp_sum.renamed1++;
+	}
+	if (pfe2->select) {
+		pfe2->select = 0;
+		panel_cmp_sum.renamed2++;
+	}
+}
+
+/* wait for the jobs of a batch and evaluate the results */
+static void
+cmp_collect(CMP_BATCH *pcb)
+{
+	int i;
+	const char *file;
+	CMP_JOB *pj;
+
+	work_wait(&pcb->group);
+	for (i = 0; i < pcb->cnt; i++) {
+		pj = pcb->job + i;
+		panel_cmp_sum.hc_lookups += pj->lookups;
+		if (pj->hit1) {
+			panel_cmp_sum.hc_hits++;
+			hc_touch(&pj->key1);
+		}
+		if (pj->hit2) {
+			panel_cmp_sum.hc_hits++;
+			hc_touch(&pj->key2);
+		}
+		if (pj->new1)
+			hc_store(&pj->key1,&pj->digest1);
+		if (pj->new2)
+			hc_store(&pj->key2,&pj->digest2);
+		if (pj->result == 0) {
+			if (pj->puf) {
+				pj->puf->hashed = 1;
+				pj->puf->digest = pj->digest1;	/* struct copy */
+			}
+			else if (pj->renamed)
+				cmp_renamed(pj->pfe1,pj->pfe2);
+			else
+				cmp_equal(pj->pfe1,pj->pfe2);
+		}
+		else if (pj->result < 0 && pj->error != CMP_ERR_NONE) {
+			/* an error in the rename detection is not counted, the pair is not a pair of same names */
+			if (!pj->renamed)
+				panel_cmp_sum.errors++;
+			file = pj->errfile == 1 ? pj->pfe1->file : USTR(pj->file2);
+			switch (pj->error) {
+			case CMP_ERR_OPEN:
+				msgout(MSG_NOTICE,"COMPARE: Cannot open \"%s%s\" (%s)",
+				  pj->errfile == 1 ? "./" : "",file,strerror(pj->errcode));
+				break;
+			case CMP_ERR_NOTREG:
+				msgout(MSG_NOTICE,"COMPARE: File \"%s%s\" is not a regular file",
+				  pj->errfile == 1 ? "./" : "",file);
+				break;
+			default:
+				msgout(MSG_NOTICE,"COMPARE: Cannot read from \"%s%s\" (%s)",
+				  pj->errfile == 1 ? "./" : "",file,strerror(pj->errcode));
+			}
+		}
+	}
+	pcb->cnt = 0;
+}
+
+/* get a free job from the batch being filled */
+static CMP_JOB *
+cmp_job(void)
+{
+	CMP_JOB *pj;
+
+	pj = cmp_batch[cmp_fill].job + cmp_batch[cmp_fill].cnt;
+	if (pj->buff1 == 0) {
+		pj->buff1 = cmp_buffer();
+		pj->buff2 = cmp_buffer();
+	}
+	pj->puf = 0;
+	return pj;
+}
+
+/* submit the job returned by cmp_job() */
+static void
+cmp_start(CMP_JOB *pj, void (*fn)(void *))
+{
+	CMP_BATCH *pcb;
+
+	pcb = cmp_batch + cmp_fill;
+	pcb->cnt++;
+	work_submit(&pcb->group,fn,pj);
+
+	if (pcb->cnt == CMP_JOBS) {
+		/* switch to the other batch */
+		cmp_fill = 1 - cmp_fill;
+		cmp_collect(cmp_batch + cmp_fill);
+	}
+}
+
+/*
+ * submit a data comparison of the pair, 'file2' is the second file's pathname,
+ * 'renamed' is set when comparing files with different names
+ */
+static void
+cmp_submit(FILE_ENTRY *pfe1, FILE_ENTRY *pfe2, const char *file2, int renamed)
+{
+	CMP_JOB *pj;
+
+	pj = cmp_job();
+	pj->pfe1 = pfe1;
+	pj->pfe2 = pfe2;
+	pj->renamed = renamed;
+	us_copy(&pj->file2,file2);
+	cmp_start(pj,file_cmp);
+}
+
+/* submit the hashing of a unique file, 'file' is its pathname */
+static void
+hash_submit(UNIQUE_FILE *puf, const char *file)
+{
+	CMP_JOB *pj;
+
+	pj = cmp_job();
+	pj->pfe1 = puf->pfe;
+	pj->pfe2 = 0;
+	pj->renamed = 1;	/* errors are not counted */
+	pj->puf = puf;
+	puf->hashed = 0;
+	us_copy(&pj->file2,file);
+	cmp_start(pj,file_hash);
+}
+
+/* wait for all submitted jobs, the older batch first */
+static void
+cmp_wait(void)
+{
+	cmp_collect(cmp_batch + 1 - cmp_fill);
+	cmp_collect(cmp_batch + cmp_fill);
+}
+
+/* wait for all comparisons, update the hash cache, release the buffers */
+static void
+cmp_finish(void)
+{
+	int i, j;
+	CMP_JOB *pj;
+
+	cmp_wait();
+	hc_commit();
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < CMP_JOBS; j++) {
+			pj = cmp_batch[i].job + j;
+			efree(pj->buff1);
+			efree(pj->buff2);
+			pj->buff1 = pj->buff2 = 0;
+			us_reset(&pj->file2);
+		}
+}
+
+/*
+ * Matching the names: panel #1 candidates are stored in 'p1'. If both
+ * panels are sorted by name in the C locale (strcmp() order), the panels
+ * are merged in one pass, otherwise a hash table of 'p1' is used.
+ */
+static FILE_ENTRY **p1 = 0;		/* panel #1 candidates */
+static FLAG *p1_paired;			/* a file with the same name found in panel #2 */
+static int p1_alloc = 0;
+static int p1_cnt, p1_next;		/* p1_next: merge position or -1 if not merging */
+static int *p1_hash = 0;		/* index to 'p1' or -1 = free */
+static unsigned int p1_hash_size = 0;
+
+static int
+names_sorted(FILE_ENTRY **list, int cnt)
+{
+	int i;
+
+	for (i = 1; i < cnt; i++)
+		if (strcmp(list[i - 1]->file,list[i]->file) >= 0)
+			return 0;
+	return 1;
+}
+
+/* prepare the name matching */
+static void
+match_init(FILE_ENTRY **list2, int cnt2)
+{
+	int i;
+	unsigned int size, h;
+
+	if (names_sorted(p1,p1_cnt) && names_sorted(list2,cnt2)) {
+		p1_next = 0;
+		return;
+	}
+
+	p1_next = -1;
+	for (size = 64; size < 2 * p1_cnt; size *= 2)
+		;
+	if (size != p1_hash_size) {
+		efree(p1_hash);
+		p1_hash = emalloc((p1_hash_size = size) * sizeof(int));
+	}
+	for (h = 0; h < size; h++)
+		p1_hash[h] = -1;
+	for (i = 0; i < p1_cnt; i++) {
+		for (h = strhash(p1[i]->file) & (size - 1); p1_hash[h] >= 0; h = (h + 1) & (size - 1))
+			;
+		p1_hash[h] = i;
+	}
+}
+
+/* find a panel #1 candidate with the given name, return its index or -1 */
+static int
+match_name(const char *name)
+{
+	int i, cmp;
+	unsigned int h;
+
+	if (p1_next >= 0) {
+		/* merge */
+		for (; p1_next < p1_cnt; p1_next++) {
+			if ((cmp = strcmp(p1[p1_next]->file,name)) == 0)
+				return p1_next++;
+			if (cmp > 0)
+				break;
+		}
+		return -1;
+	}
+
+	for (h = strhash(name) & (p1_hash_size - 1); (i = p1_hash[h]) >= 0; h = (h + 1) & (p1_hash_size - 1))
+		if (strcmp(p1[i]->file,name) == 0)
+			return i;
+	return -1;
+}
+
+/* compare the attributes selected by the options, return 0 if equal */
+static int
+attr_cmp(FILE_ENTRY *pfe1, FILE_ENTRY *pfe2)
+{
+	/* always comparing type */
+	if (pfe1->file_type == FT_NA || !(
+		(IS_FT_PLAIN(pfe1->file_type) && IS_FT_PLAIN(pfe2->file_type))
+		|| (IS_FT_DIR(pfe1->file_type) && IS_FT_DIR(pfe2->file_type))
+		|| (pfe1->file_type == pfe2->file_type) )
+	  )
+		return 1;
+	if (pfe1->symlink != pfe2->symlink)
+		return 1;
+
+	/* comparing size (or device numbers) */
+	if (COPT(CMP_SIZE)
+	  && ((IS_FT_DEV(pfe1->file_type) && pfe1->extra->devnum != pfe2->extra->devnum)
+	  || (IS_FT_PLAIN(pfe1->file_type) && pfe1->size != pfe2->size)))
+		return 1;
+
+	if (COPT(CMP_OWNER)
+	  && (pfe1->uid != pfe2->uid || pfe1->gid != pfe2->gid))
+		return 1;
+
+	if (COPT(CMP_MODE) && pfe1->mode12 != pfe2->mode12)
+		return 1;
+
+	return 0;
+}
+
+#define RENAME_MAX	100		/* max number of candidates for one file */
+
+static int
+qcmp_unique(const void *e1, const void *e2)
+{
+	int cmp;
+	const UNIQUE_FILE *puf1, *puf2;
+
+	puf1 = e1;
+	puf2 = e2;
+	if ( (cmp = CMP(puf1->pfe->size,puf2->pfe->size)) )
+		return cmp;
+	if ( (cmp = CMP(puf1->digest.h1,puf2->digest.h1)) )
+		return cmp;
+	if ( (cmp = CMP(puf1->digest.h2,puf2->digest.h2)) )
+		return cmp;
+	return puf1->panel - puf2->panel;
+}
+
+static int
+unique_eq(const UNIQUE_FILE *puf1, const UNIQUE_FILE *puf2)
+{
+	return puf1->pfe->size == puf2->pfe->size && digest_cmp(&puf1->digest,&puf2->digest) == 0;
+}
+
+/*
+ * rename detection, 'u2' are the unique files from panel #2
+ *
+ * Unique files having the same size as a unique file in the other
+ * panel are hashed (each of them only once), then the files are
+ * joined on size and hash and the data of the pairs with equal
+ * hashes is compared to confirm the match.
+ */
+static void
+cmp_unique(FILE_ENTRY **u2, int u2_cnt)
+{
+	int i, j, k, m, n, u1_cnt, uf_cnt, cand;
+	off_t size;
+	FILE_ENTRY *pfe1, *pfe2;
+	UNIQUE_FILE *puf;
+	FLAG incomplete;
+	static UNIQUE_FILE *uf = 0;
+	static int uf_alloc = 0;
+
+	/* unique files from panel #1 are moved to the beginning of 'p1' */
+	for (u1_cnt = i = 0; i < p1_cnt; i++) {
+		pfe1 = p1[i];
+		if (!p1_paired[i] && IS_FT_PLAIN(pfe1->file_type) && pfe1->size > 0)
+			p1[u1_cnt++] = pfe1;
+	}
+	for (n = i = 0; i < u2_cnt; i++) {
+		pfe2 = u2[i];
+		if (IS_FT_PLAIN(pfe2->file_type) && pfe2->size > 0)
+			u2[n++] = pfe2;
+	}
+	u2_cnt = n;
+	if (u1_cnt == 0 || u2_cnt == 0)
+		return;
+	if (uf_alloc < u1_cnt + u2_cnt) {
+		efree(uf);
+		uf = emalloc((uf_alloc = u1_cnt + u2_cnt) * sizeof(UNIQUE_FILE));
+	}
+
+	/* size buckets: hash the files of sizes found in both panels */
+	qsort(p1,u1_cnt,sizeof(FILE_ENTRY *),qcmp_size);
+	qsort(u2,u2_cnt,sizeof(FILE_ENTRY *),qcmp_size);
+	for (uf_cnt = i = j = 0; i < u1_cnt && j < u2_cnt && !ctrlc_flag; ) {
+		if ((size = p1[i]->size) != u2[j]->size) {
+			if (size < u2[j]->size)
+				i++;
+			else
+				j++;
+			continue;
+		}
+		for (; i < u1_cnt && p1[i]->size == size; i++) {
+			puf = uf + uf_cnt++;
+			puf->pfe = p1[i];
+			puf->panel = 1;
+			hash_submit(puf,puf->pfe->file);
+		}
+		for (; j < u2_cnt && u2[j]->size == size; j++) {
+			puf = uf + uf_cnt++;
+			puf->pfe = u2[j];
+			puf->panel = 2;
+			hash_submit(puf,pathname_join(puf->pfe->file));
+		}
+	}
+	cmp_wait();
+	if (ctrlc_flag)
+		return;
+
+	/* join on size and hash */
+	for (n = i = 0; i < uf_cnt; i++)
+		if (uf[i].hashed)
+			uf[n++] = uf[i];
+	uf_cnt = n;
+	if (uf_cnt > 1)
+		qsort(uf,uf_cnt,sizeof(UNIQUE_FILE),qcmp_unique);
+	incomplete = 0;
+	for (i = 0; i < uf_cnt && !ctrlc_flag; i = n) {
+		/* equal size and hash: [i .. j) from panel #1, [j .. n) from panel #2 */
+		for (j = i; j < uf_cnt && uf[j].panel == 1 && unique_eq(uf + i,uf + j); j++)
+			;
+		for (n = j; n < uf_cnt && unique_eq(uf + i,uf + n); n++)
+			;
+		for (k = j; k < n; k++) {
+			pfe2 = uf[k].pfe;
+			for (cand = 0, m = i; m < j; m++) {
+				pfe1 = uf[m].pfe;
+				if (attr_cmp(pfe1,pfe2))
+					continue;
+				if (++cand > RENAME_MAX) {
+					incomplete = 1;
+					break;
+				}
+				cmp_submit(pfe1,pfe2,pathname_join(pfe2->file),1);
+			}
+		}
+	}
+
+	if (incomplete)
+		msgout(MSG_NOTICE,"COMPARE: Too many files with equal data, rename detection is incomplete");
+}
+
+/*
+ * Recursive comparison: both directory trees are walked in parallel,
+ * each pair of directories is compared by a job running in a worker
+ * thread. The main thread collects the results of each finished job
+ * and reuses its slot for the next directory waiting in the queue,
+ * subdirectories found by a job are added to the queue. A job
+ * uses only descriptor relative system calls (openat(), fstatat()),
+ * the pathnames of the roots are not needed. A job must not call
+ * emalloc(), if it runs out of memory, it stops and the directory
+ * is reported as an error.
+ */
+#define TREE_JOBS	16		/* jobs running at the same time */
+
+typedef struct {
+	CODE reason;			/* one of DIFF_XXX */
+	int errcode;			/* DIFF_ERROR: errno or 0 */
+	const char *path;		/* relative pathname */
+} TREE_DIFF;
+
+typedef struct {
+	HC_KEY key;
+	HC_DIGEST digest;
+	FLAG hit;				/* found in the cache, otherwise new */
+} TREE_HASH;
+
+typedef struct {
+	const char *dir;		/* directory relative to both roots, "" = the roots */
+	WORK_GROUP group;		/* this job only */
+	ARENA arena;			/* names and pathnames */
+	CMP_JOB cj;				/* data comparison */
+	const char **name1, **name2;	/* directory contents */
+	int alloc1, alloc2;
+	TREE_DIFF *diff;		/* results: differences */
+	int diff_cnt, diff_alloc;
+	const char **sub;		/* results: subdirectories to be compared */
+	int sub_cnt, sub_alloc;
+	TREE_HASH *hash;		/* results: hash cache updates */
+	int hash_cnt, hash_alloc;
+	int lookups;			/* hash cache lookups */
+	FLAG nomem;				/* out of memory, the results are incomplete */
+} TREE_JOB;
+
+static TREE_JOB tree_job[TREE_JOBS];
+static int tree_root1, tree_root2;	/* descriptors of the panel directories */
+
+/* return the pathname or null if out of memory */
+static const char *
+tree_path(TREE_JOB *pt, const char *name)
+{
+	char *path;
+	size_t len1, len2;
+
+	if (*pt->dir == '\0')
+		return name;
+	len1 = strlen(pt->dir);
+	len2 = strlen(name);
+	if ((path = arena_tryalloc(&pt->arena,len1 + len2 + 2)) == 0) {
+		pt->nomem = 1;
+		return 0;
+	}
+	memcpy(path,pt->dir,len1);
+	path[len1] = '/';
+	memcpy(path + len1 + 1,name,len2 + 1);
+	return path;
+}
+
+static void
+tree_diff(TREE_JOB *pt, int reason, const char *name, int errcode)
+{
+	const char *path;
+	TREE_DIFF *pd;
+
+	if ((path = name ? tree_path(pt,name) : pt->dir) == 0)
+		return;
+	if (pt->diff_cnt == pt->diff_alloc) {
+		if ((pd = realloc(pt->diff,(pt->diff_alloc + 64) * sizeof(TREE_DIFF))) == 0) {
+			pt->nomem = 1;
+			return;
+		}
+		pt->diff = pd;
+		pt->diff_alloc += 64;
+	}
+	pd = pt->diff + pt->diff_cnt++;
+	pd->reason = reason;
+	pd->errcode = errcode;
+	pd->path = path;
+}
+
+static void
+tree_hash(TREE_JOB *pt, const HC_KEY *pk, const HC_DIGEST *pd, int hit)
+{
+	TREE_HASH *ph;
+
+	if (pt->hash_cnt == pt->hash_alloc) {
+		if ((ph = realloc(pt->hash,(pt->hash_alloc + 64) * sizeof(TREE_HASH))) == 0) {
+			pt->nomem = 1;
+			return;
+		}
+		pt->hash = ph;
+		pt->hash_alloc += 64;
+	}
+	ph = pt->hash + pt->hash_cnt++;
+	ph->key = *pk;			/* struct copy */
+	ph->digest = *pd;		/* struct copy */
+	ph->hit = hit;
+}
+
+static int
+qcmp_name(const void *e1, const void *e2)
+{
+	return strcmp(*(const char **)e1,*(const char **)e2);
+}
+
+static DIR *
+tree_opendir(int root, const char *dir)
+{
+	int fd, errcode;
+	DIR *dd;
+
+	if ((fd = openat(root,dir,O_RDONLY | O_DIRECTORY)) < 0)
+		return 0;
+	if ((dd = fdopendir(fd)) == 0) {
+		errcode = errno;
+		close(fd);
+		errno = errcode;
+	}
+	return dd;
+}
+
+/* read and sort the names */
+static int
+tree_readdir(TREE_JOB *pt, DIR *dd, const char ***plist, int *palloc)
+{
+	int cnt;
+	size_t size;
+	const char *name, **list;
+	char *copy;
+	struct dirent *direntry;
+
+	for (cnt = 0; (direntry = readdir(dd)); ) {
+		name = direntry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+		if (cnt == *palloc) {
+			if ((list = realloc(*plist,(*palloc + 256) * sizeof(const char *))) == 0)
+				break;
+			*plist = list;
+			*palloc += 256;
+		}
+		size = strlen(name) + 1;
+		if ((copy = arena_tryalloc(&pt->arena,size)) == 0)
+			break;
+		(*plist)[cnt++] = memcpy(copy,name,size);
+	}
+	if (direntry)
+		/* the loop ends early only when out of memory */
+		pt->nomem = 1;
+	if (cnt > 1)
+		qsort(*plist,cnt,sizeof(const char *),qcmp_name);
+	return cnt;
+}
+
+/* a name exists in one of the directories only */
+static void
+tree_unique(TREE_JOB *pt, int dfd, const char *name, int reason)
+{
+	struct stat st;
+
+	if (COPT(CMP_REGULAR) && (fstatat(dfd,name,&st,AT_SYMLINK_NOFOLLOW) < 0
+	  || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))))
+		return;
+	tree_diff(pt,reason,name,0);
+}
+
+/* return value: 0 = equal, 1 = differ, -1 = out of memory */
+static int
+tree_link_cmp(int dfd1, int dfd2, const char *name, off_t size)
+{
+	char *link1, *link2;
+	ssize_t len1, len2;
+	int result;
+
+	link1 = malloc(size + 1);
+	link2 = malloc(size + 1);
+	if (link1 == 0 || link2 == 0) {
+		free(link1);
+		free(link2);
+		return -1;
+	}
+	len1 = readlinkat(dfd1,name,link1,size + 1);
+	len2 = readlinkat(dfd2,name,link2,size + 1);
+	result = len1 < 0 || len1 != len2 || memcmp(link1,link2,len1) != 0;
+	free(link1);
+	free(link2);
+	return result;
+}
+
+/* a name exists in both directories */
+static void
+tree_entry(TREE_JOB *pt, int dfd1, int dfd2, const char *name)
+{
+	int result;
+	const char **sub;
+	struct stat st1, st2;
+	CMP_JOB *pj;
+
+	if (fstatat(dfd1,name,&st1,AT_SYMLINK_NOFOLLOW) < 0
+	  || fstatat(dfd2,name,&st2,AT_SYMLINK_NOFOLLOW) < 0) {
+		tree_diff(pt,DIFF_ERROR,name,errno);
+		return;
+	}
+
+	if ((st1.st_mode & S_IFMT) != (st2.st_mode & S_IFMT)) {
+		if (!COPT(CMP_REGULAR) || S_ISREG(st1.st_mode) || S_ISREG(st2.st_mode))
+			tree_diff(pt,DIFF_TYPE,name,0);
+		return;
+	}
+
+	if (S_ISDIR(st1.st_mode)) {
+		if (pt->sub_cnt == pt->sub_alloc) {
+			if ((sub = realloc(pt->sub,(pt->sub_alloc + 64) * sizeof(const char *))) == 0) {
+				pt->nomem = 1;
+				return;
+			}
+			pt->sub = sub;
+			pt->sub_alloc += 64;
+		}
+		if ((pt->sub[pt->sub_cnt] = tree_path(pt,name)) == 0)
+			return;
+		pt->sub_cnt++;
+	}
+	else if (COPT(CMP_REGULAR) && !S_ISREG(st1.st_mode))
+		return;
+
+	/* comparing size (or device numbers) */
+	if (S_ISREG(st1.st_mode) || S_ISLNK(st1.st_mode)) {
+		if ((COPT(CMP_SIZE) || COPT(CMP_DATA)) && st1.st_size != st2.st_size) {
+			tree_diff(pt,DIFF_SIZE,name,0);
+			return;
+		}
+	}
+#ifdef HAVE_STRUCT_STAT_ST_RDEV
+	else if ((S_ISCHR(st1.st_mode) || S_ISBLK(st1.st_mode))
+	  && COPT(CMP_SIZE) && st1.st_rdev != st2.st_rdev) {
+		tree_diff(pt,DIFF_SIZE,name,0);
+		return;
+	}
+#endif
+
+	if (COPT(CMP_MODE) && (st1.st_mode & 07777) != (st2.st_mode & 07777)) {
+		tree_diff(pt,DIFF_MODE,name,0);
+		return;
+	}
+
+	if (COPT(CMP_OWNER) && (st1.st_uid != st2.st_uid || st1.st_gid != st2.st_gid)) {
+		tree_diff(pt,DIFF_OWNER,name,0);
+		return;
+	}
+
+	if (!COPT(CMP_DATA))
+		return;
+	if (S_ISLNK(st1.st_mode)) {
+		/* the data of a symbolic link is the link target */
+		if ((result = tree_link_cmp(dfd1,dfd2,name,st1.st_size)) < 0)
+			pt->nomem = 1;
+		else if (result)
+			tree_diff(pt,DIFF_DATA,name,0);
+		return;
+	}
+	if (!S_ISREG(st1.st_mode))
+		return;
+
+	pj = &pt->cj;
+	result = pair_cmp(pj,dfd1,name,dfd2,name);
+	pt->lookups += pj->lookups;
+	if (pj->hit1 || pj->new1)
+		tree_hash(pt,&pj->key1,&pj->digest1,pj->hit1);
+	if (pj->hit2 || pj->new2)
+		tree_hash(pt,&pj->key2,&pj->digest2,pj->hit2);
+	if (result > 0)
+		tree_diff(pt,DIFF_DATA,name,0);
+	else if (result < 0 && pj->error != CMP_ERR_NONE)
+		tree_diff(pt,DIFF_ERROR,name,pj->errcode);
+}
+
+/* job function: compare one pair of directories */
+static void
+tree_cmp(void *arg)
+{
+	int i, j, cmp, cnt1, cnt2, fd1, fd2;
+	const char *dir;
+	DIR *dd1, *dd2;
+	TREE_JOB *pt;
+
+	pt = arg;
+	arena_reset(&pt->arena);
+	pt->diff_cnt = pt->sub_cnt = pt->hash_cnt = pt->lookups = 0;
+	pt->nomem = 0;
+
+	dir = *pt->dir ? pt->dir : ".";
+	if ((dd1 = tree_opendir(tree_root1,dir)) == 0) {
+		tree_diff(pt,DIFF_ERROR,0,errno);
+		return;
+	}
+	if ((dd2 = tree_opendir(tree_root2,dir)) == 0) {
+		tree_diff(pt,DIFF_ERROR,0,errno);
+		closedir(dd1);
+		return;
+	}
+	fd1 = dirfd(dd1);
+	fd2 = dirfd(dd2);
+	cnt1 = tree_readdir(pt,dd1,&pt->name1,&pt->alloc1);
+	cnt2 = tree_readdir(pt,dd2,&pt->name2,&pt->alloc2);
+
+	/* merge the sorted lists */
+	for (i = j = 0; (i < cnt1 || j < cnt2) && !ctrlc_flag && !pt->nomem; ) {
+		cmp = i == cnt1 ? 1 : j == cnt2 ? -1 : strcmp(pt->name1[i],pt->name2[j]);
+		if (cmp < 0)
+			tree_unique(pt,fd1,pt->name1[i++],DIFF_ONLY1);
+		else if (cmp > 0)
+			tree_unique(pt,fd2,pt->name2[j++],DIFF_ONLY2);
+		else {
+			tree_entry(pt,fd1,fd2,pt->name1[i]);
+			i++;
+			j++;
+		}
+	}
+	closedir(dd1);
+	closedir(dd2);
+}
+
+/* store one result of tree_cmp(), return 1 if it is an error */
+static int
+tree_result(int reason, const char *path, int errcode)
+{
+	CMP_DIFF *pd;
+
+	if (panel_cmp_tree.pd->cnt == panel_cmp_tree.alloc)
+		panel_cmp_tree.diff = erealloc(panel_cmp_tree.diff,
+		  (panel_cmp_tree.alloc += 256) * sizeof(CMP_DIFF));
+	pd = panel_cmp_tree.diff + panel_cmp_tree.pd->cnt++;
+	pd->reason = reason;
+	pd->path = arena_strdup(&panel_cmp_tree.arena,path);
+	if (reason != DIFF_ERROR)
+		return 0;
+	msgout(MSG_NOTICE,"COMPARE: Cannot compare \"%s\" (%s)",
+	  *path ? path : ".",errcode ? strerror(errcode) : "?");
+	return 1;
+}
+
+static int
+qcmp_diff(const void *e1, const void *e2)
+{
+	return strcmp(((CMP_DIFF *)e1)->path,((CMP_DIFF *)e2)->path);
+}
+
+static void
+cmp_trees(void)
+{
+	int i, j, dircnt, q_cnt, errors, run_cnt, idle_cnt;
+	TREE_JOB *pt;
+	TREE_DIFF *ptd;
+	CMP_DIFF *pd;
+	TREE_JOB *run[TREE_JOBS], *idle[TREE_JOBS];
+	WORK_GROUP *run_group[TREE_JOBS];	/* for work_wait_any() */
+	static const char **queue = 0;	/* directories waiting for comparison */
+	static int q_alloc = 0;
+	static ARENA q_arena = ANULL;	/* memory for 'queue' */
+
+	panel_cmp_tree.pd->cnt = 0;
+	arena_reset(&panel_cmp_tree.arena);
+
+	if ((tree_root1 = open(USTR(ppanel_file->dir),O_RDONLY | O_DIRECTORY)) < 0) {
+		msgout(MSG_w,"COMPARE: Cannot open the directory \"%s\" (%s)",
+		  USTR(ppanel_file->dir),strerror(errno));
+		return;
+	}
+	if ((tree_root2 = open(USTR(ppanel_file->other->dir),O_RDONLY | O_DIRECTORY)) < 0) {
+		msgout(MSG_w,"COMPARE: Cannot open the directory \"%s\" (%s)",
+		  USTR(ppanel_file->other->dir),strerror(errno));
+		close(tree_root1);
+		return;
+	}
+
+	ctrlc_flag = 0;
+	signal_ctrlc_on();
+	win_waitmsg();
+	if (COPT(CMP_DATA)) {
+		hc_load();
+		for (i = 0; i < TREE_JOBS; i++) {
+			tree_job[i].cj.buff1 = cmp_buffer();
+			tree_job[i].cj.buff2 = cmp_buffer();
+		}
+	}
+	panel_cmp_sum.hc_lookups = panel_cmp_sum.hc_hits = 0;
+
+	arena_reset(&q_arena);
+	if (q_alloc == 0)
+		queue = emalloc((q_alloc = 256) * sizeof(const char *));
+	queue[0] = "";
+	q_cnt = 1;
+	for (i = 0; i < TREE_JOBS; i++)
+		idle[i] = tree_job + i;
+	idle_cnt = TREE_JOBS;
+	run_cnt = 0;
+	for (dircnt = errors = 0; /* until break */; ) {
+		/* keep all slots busy, after a ctrl-C only wait for the running jobs */
+		while (idle_cnt > 0 && q_cnt > 0 && !ctrlc_flag) {
+			pt = run[run_cnt] = idle[--idle_cnt];
+			run_group[run_cnt++] = &pt->group;
+			pt->dir = queue[--q_cnt];
+			work_submit(&pt->group,tree_cmp,pt);
+		}
+		if ((i = work_wait_any(run_group,run_cnt)) < 0)
+			break;
+		pt = idle[idle_cnt++] = run[i];
+		run[i] = run[--run_cnt];
+		run_group[i] = run_group[run_cnt];
+		dircnt++;
+
+		/* results */
+		for (j = 0; j < pt->diff_cnt; j++) {
+			ptd = pt->diff + j;
+			errors += tree_result(ptd->reason,ptd->path,ptd->errcode);
+		}
+		if (pt->nomem)
+			errors += tree_result(DIFF_ERROR,pt->dir,ENOMEM);
+		for (j = 0; j < pt->sub_cnt; j++) {
+			if (q_cnt == q_alloc)
+				queue = erealloc(queue,(q_alloc *= 2) * sizeof(const char *));
+			queue[q_cnt++] = arena_strdup(&q_arena,pt->sub[j]);
+		}
+		panel_cmp_sum.hc_lookups += pt->lookups;
+		for (j = 0; j < pt->hash_cnt; j++)
+			if (pt->hash[j].hit) {
+				panel_cmp_sum.hc_hits++;
+				hc_touch(&pt->hash[j].key);
+			}
+			else
+				hc_store(&pt->hash[j].key,&pt->hash[j].digest);
+	}
+
+	if (COPT(CMP_DATA)) {
+		hc_commit();
+		for (i = 0; i < TREE_JOBS; i++) {
+			efree(tree_job[i].cj.buff1);
+			efree(tree_job[i].cj.buff2);
+			tree_job[i].cj.buff1 = tree_job[i].cj.buff2 = 0;
+		}
+	}
+	for (i = 0; i < TREE_JOBS; i++)
+		arena_trim(&tree_job[i].arena,0);
+	arena_trim(&q_arena,0);
+	close(tree_root1);
+	close(tree_root2);
+	signal_ctrlc_off();
+
+	if (ctrlc_flag) {
+		msgout(MSG_i,"COMPARE: operation canceled");
+		panel_cmp_tree.pd->cnt = 0;
+		next_mode = MODE_SPECIAL_RETURN;
+		return;
+	}
+
+	if (panel_cmp_tree.pd->cnt > 1)
+		qsort(panel_cmp_tree.diff,panel_cmp_tree.pd->cnt,sizeof(CMP_DIFF),qcmp_diff);
+	for (i = 0; i < panel_cmp_tree.pd->cnt; i++) {
+		pd = panel_cmp_tree.diff + i;
+		pd->pathw = arena_wcsdup(&panel_cmp_tree.arena,convert2w(*pd->path ? pd->path : "."));
+	}
+	panel_cmp_tree.dirs = dircnt;
+	panel_cmp_tree.errors = errors;
+	next_mode = MODE_CMP_TREE;
+}
+
+/* compare the contents of both panels, the panels must be up to date */
+void
+cmp_panels(void)
+{
+	int i, j, cnt1, selcnt2, u2_cnt;
 	const char *name2;
 	FILE_ENTRY *pfe1, *pfe2;
-	static FILE_ENTRY **p1 = 0;	/* copy of panel #1 sorted for binary search */
-	static int p1_alloc = 0;
+	FLAG renames;
+	static FILE_ENTRY **u2 = 0;	/* unique files from panel #2 */
+	static int u2_alloc = 0;
 
 	/*
 	 * - select all files and both panels
@@ -190,17 +1398,19 @@ cmp_directories(void)
 	 *		- find a matching file from panel #1
 	 *		- if a pair is found, compare them according to the selected options
 	 *		- if the compared files are equal, deselect them
+	 * - optionally compare the data of unique files to find renamed files
 	 */
 
 	panel_cmp_sum.errors = panel_cmp_sum.names = panel_cmp_sum.equal = 0;
-
-	/* reread panels */
-	list_both_directories();
+	panel_cmp_sum.renamed1 = panel_cmp_sum.renamed2 = 0;
+	panel_cmp_sum.hc_lookups = panel_cmp_sum.hc_hits = 0;
+	renames = panel_cmp_sum.renames = COPT(CMP_DATA) && COPT(CMP_RENAMED);
 
 	ctrlc_flag = 0;
 	if (COPT(CMP_DATA)) {	/* going to compare data */
 		signal_ctrlc_on();
 		win_waitmsg();
+		hc_load();
 		pathname_set_directory(USTR(ppanel_file->other->dir));
 	}
 
@@ -216,32 +1426,32 @@ cmp_directories(void)
 		cnt1 = ppanel_file->pd->cnt;
 		panel_cmp_sum.nonreg1 = 0;
 	}
-	selcnt1 = cnt1;
 
-	if (cnt1) {
-		if (p1_alloc < cnt1) {
-			efree(p1);
-			p1_alloc = cnt1;
-			p1 = emalloc(p1_alloc * sizeof(FILE_ENTRY *));
+	if (p1_alloc < cnt1) {
+		efree(p1);
+		efree(p1_paired);
+		p1_alloc = cnt1;
+		p1 = emalloc(p1_alloc * sizeof(FILE_ENTRY *));
+		p1_paired = emalloc(p1_alloc * sizeof(FLAG));
+	}
+	if (COPT(CMP_REGULAR))
+		for (i = j = 0; i < ppanel_file->pd->cnt; i++) {
+			pfe1 = ppanel_file->files[i];
+			if (pfe1->select)
+				p1[j++] = pfe1;
 		}
-
-		if (COPT(CMP_REGULAR))
-			for (i = j = 0; i < ppanel_file->pd->cnt; i++) {
-				pfe1 = ppanel_file->files[i];
-				if (pfe1->select)
-					p1[j++] = pfe1;
-			}
-		else
-			for (i = 0; i < ppanel_file->pd->cnt; i++) {
-				pfe1 = p1[i] = ppanel_file->files[i];
-				pfe1->select = 1;
+	else
+		for (i = 0; i < ppanel_file->pd->cnt; i++) {
+			pfe1 = p1[i] = ppanel_file->files[i];
+			pfe1->select = 1;
 		}
-
-		qsort(p1,cnt1,sizeof(FILE_ENTRY *),qcmp);
-	}
+	p1_cnt = cnt1;
+	for (i = 0; i < cnt1; i++)
+		p1_paired[i] = 0;
+	match_init(ppanel_file->other->files,ppanel_file->other->pd->cnt);
 
 	panel_cmp_sum.nonreg2 = 0;
-	selcnt2 = 0;
+	selcnt2 = u2_cnt = 0;
 	for (i = 0; i < ppanel_file->other->pd->cnt; i++) {
 		pfe2 = ppanel_file->other->files[i];
 		if ( !(pfe2->select = !COPT(CMP_REGULAR) || IS_FT_PLAIN(pfe2->file_type)) ) {
@@ -250,81 +1460,52 @@ cmp_directories(void)
 		}
 		selcnt2++;
 
-		if (panel_cmp_sum.names == cnt1)
-			/* we have seen all files from panel#1 */
-			continue;	/* not break */
-
-		name2 = SDSTR(pfe2->file);
-		for (pfe1 = 0, min = 0, max = cnt1 - 1; min <= max; ) {
-			med = (min + max) / 2;
-			cmp = strcmp(name2,SDSTR(p1[med]->file));
-			if (cmp == 0) {
-				pfe1 = p1[med];
-				/* entries *pfe1 and *pfe2 have the same name */
-				break;
+		name2 = pfe2->file;
+		/* if we have seen all files from panel#1, the rest is unique */
+		if (panel_cmp_sum.names == cnt1 || (j = match_name(name2)) < 0) {
+			if (renames) {
+				if (u2_cnt == u2_alloc)
+					u2 = erealloc(u2,(u2_alloc += 256) * sizeof(FILE_ENTRY *));
+				u2[u2_cnt++] = pfe2;
 			}
-			if (cmp < 0)
-				max = med - 1;
-			else
-				min = med + 1;
-		}
-		if (pfe1 == 0 || !pfe1->select)
 			continue;
-
+		}
+		/* entries *pfe1 and *pfe2 have the same name */
+		pfe1 = p1[j];
+		p1_paired[j] = 1;
 		panel_cmp_sum.names++;
 
-		/* always comparing type */
-		if (pfe1->file_type == FT_NA || !(
-			(IS_FT_PLAIN(pfe1->file_type) && IS_FT_PLAIN(pfe2->file_type))
-			|| (IS_FT_DIR(pfe1->file_type) && IS_FT_DIR(pfe2->file_type))
-			|| (pfe1->file_type == pfe2->file_type) )
-		  )
-			continue;
-		if (pfe1->symlink != pfe2->symlink)
-			continue;
-
-		/* comparing size (or device numbers) */
-		if (COPT(CMP_SIZE)
-		  && ((IS_FT_DEV(pfe1->file_type) && pfe1->devnum != pfe2->devnum)
-		  || (IS_FT_PLAIN(pfe1->file_type) && pfe1->size != pfe2->size)))
-			continue;
-
-		if (COPT(CMP_OWNER)
-		  && (pfe1->uid != pfe2->uid || pfe1->gid != pfe2->gid))
-			continue;
-
-		if (COPT(CMP_MODE) && pfe1->mode12 != pfe2->mode12)
+		if (attr_cmp(pfe1,pfe2))
 			continue;
 
 		if (COPT(CMP_DATA) && IS_FT_PLAIN(pfe1->file_type)) {
 			if (pfe1->size != pfe2->size)
 				continue;
-			if ( (cmp = file_cmp(SDSTR(pfe1->file),pathname_join(name2))) ) {
-				if (ctrlc_flag)
-					break;
-				if (cmp < 0)
-					panel_cmp_sum.errors++;
-				continue;
-			}
+			/* the result will be evaluated by cmp_collect() */
+			cmp_submit(pfe1,pfe2,pathname_join(name2),0);
+			if (ctrlc_flag)
+				break;
+			continue;
 		}
 
-		/* pair of matching files found */
-		pfe1->select = 0;
-		selcnt1--;
-		pfe2->select = 0;
-		selcnt2--;
-		panel_cmp_sum.equal++;
+		cmp_equal(pfe1,pfe2);
 	}
-	ppanel_file->selected = selcnt1;
-	ppanel_file->other->selected = selcnt2;
 
-	if (COPT(CMP_DATA))
+	if (renames && !ctrlc_flag)
+		cmp_unique(u2,u2_cnt);
+
+	if (COPT(CMP_DATA)) {
+		cmp_finish();
 		signal_ctrlc_off();
+	}
+	/* each equal pair is deselected in both panels, renamed files individually */
+	ppanel_file->selected = cnt1 - panel_cmp_sum.equal - panel_cmp_sum.renamed1;
+	ppanel_file->other->selected = selcnt2 - panel_cmp_sum.equal - panel_cmp_sum.renamed2;
 
 	if (ctrlc_flag) {
 		msgout(MSG_i,"COMPARE: operation canceled");
 		/* clear all marks */
-		for (i = 0; i < cnt1; i++)
+		for (i = 0; i < ppanel_file->pd->cnt; i++)
 			ppanel_file->files[i]->select = 0;
 		ppanel_file->selected = 0;
 		for (i = 0; i < ppanel_file->other->pd->cnt; i++)
@@ -338,6 +1519,19 @@ cmp_directories(void)
 	next_mode = MODE_CMP_SUM;
 }
 
+static void
+cmp_directories(void)
+{
+	if (COPT(CMP_RECURSIVE)) {
+		cmp_trees();
+		return;
+	}
+
+	/* reread panels */
+	list_both_directories();
+	cmp_panels();
+}
+
 void
 cx_cmp(void)
 {
@@ -1,5 +1,7 @@
 extern int cmp_prepare(void);
 extern int cmp_summary_prepare(void);
+extern int cmp_tree_prepare(void);
 extern const char *cmp_saveopt(void);
 extern int cmp_restoreopt(const char *);
+extern void cmp_panels(void);
 extern void cx_cmp(void);
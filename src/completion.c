@@ -36,7 +36,7 @@
 #include "lex.h"		/* usw_dequote() */
 #include "list.h"		/* stat2type() */
 #include "log.h"		/* msgout() */
-#include "match.h"		/* match_substr() */
+#include "match.h"		/* match_substr(), match_fuzzy() */
 #include "mbwstring.h"	/* convert2w() */
 #include "sort.h"		/* num_wcscoll() */
 #include "userdata.h"	/* username_find() */
@@ -231,22 +231,40 @@ qcmp_group(const void *e1, const void *e2)
 void
 compl_panel_data(void)
 {
-	int i, j;
+	int i, j, score;
+	FLAG fuzzy;
 	COMPL_ENTRY *pcc, *curs;
 
 	curs = VALID_CURSOR(panel_compl.pd) ? panel_compl.cand[panel_compl.pd->curs] : 0;
-	if (panel_compl.pd->filtering)
+	fuzzy = panel_compl.pd->filtering && FOPT(FOPT_FUZZY);
+	if (fuzzy)
+		match_fuzzy_set(panel_compl.pd->filter->line);
+	else if (panel_compl.pd->filtering)
 		match_substr_set(panel_compl.pd->filter->line);
 
 	for (i = j = 0; i < compl.cnt; i++) {
 		pcc = &cc_list[i];
 		if (pcc == curs)
 			panel_compl.pd->curs = j;
-		if (panel_compl.pd->filtering && !match_substr(SDSTR(pcc->str)))
+		if (fuzzy) {
+			if ((score = match_fuzzy(SDSTR(pcc->str))) == 0)
+				continue;
+			match_fuzzy_keep(score);
+		}
+		else if (panel_compl.pd->filtering && !match_substr(SDSTR(pcc->str)))
 			continue;
 		panel_compl.cand[j++] = pcc;
 	}
 	panel_compl.pd->cnt = j;
+	if (fuzzy) {
+		/* best matches first */
+		match_fuzzy_sort(panel_compl.cand,j,sizeof(COMPL_ENTRY *));
+		for (i = 0; i < j; i++)
+			if (panel_compl.cand[i] == curs) {
+				panel_compl.pd->curs = i;
+				break;
+			}
+	}
 }
 
 int
@@ -629,6 +629,10 @@ static MODE_DEFINITION mode_definition[] = {
 		{ "summary" },
 		L"COMPARISON SUMMARY", 0,
 		cmp_summary_prepare, { tab_panel,tab_compl_sum,0 } },
+	{ MODE_CMP_TREE, 1,
+		{ "compare" },
+		L"RECURSIVE COMPARISON RESULTS", 0,
+		cmp_tree_prepare, { tab_panel,tab_compl_sum,0 } },
 	{ MODE_COMPL, 0,
 		{ "completion" },
 		0, 0,
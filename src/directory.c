@@ -180,8 +180,8 @@ qcmp(const void *e1, const void *e2)
 void
 dir_panel_data(void)
 {
-	int i, j, cnt, sub;
-	FLAG store;
+	int i, j, cnt, sub, score;
+	FLAG store, fuzzy;
 	const char *dirname;
 	const wchar_t *dirnamew;
 
@@ -195,7 +195,10 @@ dir_panel_data(void)
 		LIMIT_MAX(dp_max,dp_alloc);
 	}
 
-	if (panel_dir.pd->filtering)
+	fuzzy = panel_dir.pd->filtering && FOPT(FOPT_FUZZY);
+	if (fuzzy)
+		match_fuzzy_set(panel_dir.pd->filter->line);
+	else if (panel_dir.pd->filtering)
 		match_substr_set(panel_dir.pd->filter->line);
 
 	for (i = cnt = 0; i < dir_cnt; i++) {
@@ -205,7 +208,9 @@ dir_panel_data(void)
 		dirnamew = USTR(dirlist[i]->dirnamew);
 		if (dirnamew == 0)
 			dirnamew = usw_convert2w(dirname,&dirlist[i]->dirnamew);
-		if (panel_dir.pd->filtering && !match_substr(dirnamew))
+		score = 0;
+		if (fuzzy ? (score = match_fuzzy(dirnamew)) == 0
+		  : panel_dir.pd->filtering && !match_substr(dirnamew))
 			continue;
 		/* compacting */
 		store = 1;
@@ -219,6 +224,7 @@ dir_panel_data(void)
 				if (sub == 1 && j >= NO_COMPACT) {
 					DP_LIST[j].name  = dirname;
 					DP_LIST[j].namew = dirnamew;
+					DP_LIST[j].score = score;
 					store = 0;
 					break;
 				}
@@ -226,11 +232,18 @@ dir_panel_data(void)
 		if (store) {
 			DP_LIST[cnt].name  = dirname;
 			DP_LIST[cnt].namew = dirnamew;
+			DP_LIST[cnt].score = score;
 			cnt++;
 		}
 	}
 
 	qsort(DP_LIST,cnt,sizeof(DIR_ENTRY),qcmp);
+	if (fuzzy) {
+		/* best matches first */
+		for (i = 0; i < cnt; i++)
+			match_fuzzy_keep(DP_LIST[i].score);
+		match_fuzzy_sort(DP_LIST,cnt,sizeof(DIR_ENTRY));
+	}
 
 	/*
 	 * Two lines like these:
@@ -363,7 +376,7 @@ filepos_save(void)
 	}
 
 	if (ppanel_file->pd->cnt) {
-		sd_copy(&top->savefile,SDSTR(ppanel_file->files[ppanel_file->pd->curs]->file));
+		sd_copy(&top->savefile,ppanel_file->files[ppanel_file->pd->curs]->file);
 		top->savecurs = ppanel_file->pd->curs;
 		top->savetop = ppanel_file->pd->top;
 	}
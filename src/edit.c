@@ -26,6 +26,7 @@
 #include "filepanel.h"		/* cx_files_enter() */
 #include "inout.h"			/* win_edit() */
 #include "history.h"		/* hist_reset_index() */
+#include "list.h"			/* file_namew() */
 #include "log.h"			/* msgout() */
 #include "mbwstring.h"		/* wc_cols() */
 #include "util.h"			/* jshash() */
@@ -604,7 +605,7 @@ edit_macro(const wchar_t *macro)
 							}
 							if (cnt++)
 								edit_nu_insertchar(L' ');
-							edit_nu_insertstr(SDSTR(pfe->filew),QUOT_NORMAL);
+							edit_nu_insertstr(file_namew(pfe),QUOT_NORMAL);
 						}
 					}
 				}
@@ -614,7 +615,7 @@ edit_macro(const wchar_t *macro)
 			case L'F':
 				if (panel->cnt > 0) {
 					pfe = ppanel_file->files[ppanel_file->pd->curs];
-					edit_nu_insertstr(SDSTR(pfe->filew),QUOT_NORMAL);
+					edit_nu_insertstr(file_namew(pfe),QUOT_NORMAL);
 				}
 				break;
 			case L':':
@@ -699,7 +700,7 @@ cx_edit_paste_link(void)
 		if (!pfe->symlink)
 			msgout(MSG_i,"not a symbolic link");
 		else {
-			edit_nu_insertstr(USTR(pfe->linkw),QUOT_NORMAL);
+			edit_nu_insertstr(pfe->extra->linkw,QUOT_NORMAL);
 			edit_insertchar(' ');
 		}
 	}
@@ -293,10 +293,12 @@ execute(const char *command, const wchar_t *commandw)
 	 * the command output. This way CLEX appears to restart faster.
 	 */
 	xterm_title_set(0,command,commandw);
-	if (ppanel_file->pd->filtering && ppanel_file->filtype == 0)
+	if (ppanel_file->pd->filtering && (ppanel_file->filtype == 0 || ppanel_file->filtype == 3))
 		ppanel_file->pd->filtering = 0;
-	list_directory();
-	ppanel_file->other->expired = 1;
+	list_directory_update();
+	if (ppanel_file->other->watch_wd < 0)
+		/* a watched panel will be updated when it becomes the current one */
+		ppanel_file->other->expired = 1;
 
 	if (retval < 0)
 		disp_data.noenter = 0;
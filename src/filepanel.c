@@ -35,6 +35,7 @@
 #include "list.h"			/* list_directory() */
 #include "mbwstring.h"		/* convert2mb() */
 #include "panel.h"			/* pan_adjust() */
+#include "sort.h"			/* sort_finish() */
 #include "undo.h"			/* undo_reset() */
 #include "userdata.h"		/* userdata_expire() */
 #include "ustringutil.h"	/* us_getcwd() */
@@ -73,6 +74,7 @@ files_initialize(void)
 	static PANEL_FILE panel_f2 = { &panel_desc_2 };
 
 	panel_f1.other = &panel_f2;
+	panel_f1.watch_fd = panel_f1.watch_wd = panel_f2.watch_fd = panel_f2.watch_wd = -1;
 	ppanel_file = panel_f2.other = &panel_f1;
 
 	if ( (bm = get_bookmark(L"DIR1")) && chdir(USTR(bm->dir)) < 0)
@@ -139,9 +141,15 @@ file_find(const char *name)
 	int i;
 
 	for (i = 0; i < ppanel_file->pd->cnt; i++)
-		if (strcmp(SDSTR(ppanel_file->files[i]->file),name) == 0)
+		if (strcmp(ppanel_file->files[i]->file,name) == 0) {
+			if (ppanel_file->partial && i >= ppanel_file->partial) {
+				/* the entry is not at its place yet */
+				sort_finish();
+				return file_find(name);
+			}
 			return i;
-	
+		}
+
 	return -1;
 }
 
@@ -231,7 +239,7 @@ cx_files_cd(void)
 
 	pfe = ppanel_file->files[ppanel_file->pd->curs];
 	if (IS_FT_DIR(pfe->file_type)) {
-		if (changedir(SDSTR(pfe->file)) == 0) {
+		if (changedir(pfe->file) == 0) {
 			win_title();
 			win_panel();
 		}
@@ -249,7 +257,7 @@ cx_files_cd_xchg(void)
 	pfe = ppanel_file->files[ppanel_file->pd->curs];
 	if (IS_FT_DIR(pfe->file_type)) {
 		panel = (ppanel_file = ppanel_file->other)->pd;
-		if (changedir(SDSTR(pfe->file)) == 0) {
+		if (changedir(pfe->file) == 0) {
 			win_title();
 			win_panel();
 			/* allow control_loop() to detect the 'panel' change */
@@ -342,7 +350,7 @@ cx_files_enter(void)
 		pfe = ppanel_file->files[ppanel_file->pd->curs];
 		if (IS_FT_DIR(pfe->file_type)) {
 			/* now doing cx_files_cd(); */
-			if (changedir(SDSTR(pfe->file)) == 0) {
+			if (changedir(pfe->file) == 0) {
 				win_title();
 				win_panel();
 			}
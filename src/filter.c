@@ -25,7 +25,7 @@
 #include "filepanel.h"		/* files_condreread() */
 #include "history.h"		/* hist_panel_data() */
 #include "inout.h"			/* win_panel() */
-#include "list.h"			/* file_panel_data() */
+#include "list.h"			/* file_panel_filter() */
 #include "log.h"			/* msgout() */
 #include "match.h" 			/* match_substr_set() */
 #include "mbwstring.h"		/* utf_iscomposing() */
@@ -287,6 +287,24 @@ filter_update_help(void)
 	msgout(MSG_i,"text not found");
 }
 
+/* is the current panel ordered by the fuzzy filter ? */
+static int
+fuzzy_ranked(void)
+{
+	if (!panel->filtering || !FOPT(FOPT_FUZZY))
+		return 0;
+	switch (panel->type) {
+	case PANEL_TYPE_COMPL:
+	case PANEL_TYPE_DIR:
+	case PANEL_TYPE_HIST:
+		return 1;
+	case PANEL_TYPE_FILE:
+		return ppanel_file->filtype == 3;
+	default:
+		return 0;
+	}
+}
+
 void
 filter_update(void)
 {
@@ -301,7 +319,7 @@ filter_update(void)
 		dir_panel_data_wrapper();
 		break;
 	case PANEL_TYPE_FILE:
-		file_panel_data();
+		file_panel_filter();
 		break;
 	case PANEL_TYPE_GROUP:
 		group_panel_data();
@@ -322,6 +340,9 @@ filter_update(void)
 		;
 	}
 	panel->filter->changed = 0;
+	if (fuzzy_ranked() && panel->cnt > 0)
+		/* the best match */
+		panel->curs = 0;
 	pan_adjust(panel);
 	win_panel();
 }
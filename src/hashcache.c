@@ -0,0 +1,401 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * persistent cache of file content hashes used by the directory compare
+ *
+ * A file is identified by its device and inode numbers, the size and the
+ * modification and status change times. If any of them changes, the cached
+ * hash is not used. The cache is stored in the configuration directory,
+ * the least recently used entries are dropped when it grows too big.
+ *
+ * hc_lookup() may be called from worker threads, but only while the
+ * cache is not modified. All other functions are for the main thread;
+ * hc_touch() updates only the usage stamps which are not read by
+ * hc_lookup(), new hashes are only queued by hc_store() and added
+ * to the cache by hc_commit() when all lookups are finished.
+ */
+
+#include "clexheaders.h"
+
+#include <sys/stat.h>		/* struct stat */
+#include <stdarg.h>			/* log.h */
+#include <stdio.h>			/* fprintf() */
+#include <stdlib.h>			/* qsort() */
+#include <string.h>			/* memcpy() */
+
+#include "hashcache.h"
+
+#include "filerw.h"			/* fr_open() */
+#include "log.h"			/* msgout() */
+#include "util.h"			/* emalloc() */
+
+#define HC_MAX			50000	/* max number of entries */
+#define HC_LINE_STR		192		/* max length of one line in the file */
+#define HC_FILESIZE_LIMIT	(HC_MAX * HC_LINE_STR)
+
+typedef struct {
+	HC_KEY key;
+	HC_DIGEST digest;
+	unsigned long used;		/* when it was used last time, see 'generation' */
+} HC_ENTRY;
+
+static HC_ENTRY *entry = 0;		/* the cache */
+static int cnt = 0, alloc = 0;
+static int *slot = 0;			/* open addressing index to 'entry', -1 = free */
+static int slot_mask;
+static HC_ENTRY *pending = 0;	/* new hashes to be added */
+static int p_cnt = 0, p_alloc = 0;
+static unsigned long generation = 1;	/* incremented with each use of the cache */
+static FLAG loaded = 0, changed = 0;
+
+/* 128-bit MurmurHash3 (x64 variant) by Austin Appleby, public domain */
+
+#define ROTL64(X,R)	((X) << (R) | (X) >> (64 - (R)))
+#define C1	0x87c37b91114253d5ULL
+#define C2	0x4cf5ad432745937fULL
+
+static uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static uint64_t
+get64(const unsigned char *p)
+{
+	int i;
+	uint64_t k;
+
+	/* little endian, independent of the platform */
+	for (k = 0, i = 7; i >= 0; i--)
+		k = k << 8 | p[i];
+	return k;
+}
+
+void
+hc_hash_init(HC_STATE *ps)
+{
+	ps->digest.h1 = ps->digest.h2 = 0;
+	ps->len = 0;
+}
+
+/* all but the last chunk of data must have the size divisible by 16 */
+void
+hc_hash_update(HC_STATE *ps, const char *data, size_t size)
+{
+	const unsigned char *p, *tail;
+	uint64_t h1, h2, k1, k2;
+	size_t i, blocks;
+
+	p = (const unsigned char *)data;
+	h1 = ps->digest.h1;
+	h2 = ps->digest.h2;
+	blocks = size / 16;
+	for (i = 0; i < blocks; i++, p += 16) {
+		k1 = get64(p);
+		k2 = get64(p + 8);
+
+		k1 *= C1; k1 = ROTL64(k1,31); k1 *= C2; h1 ^= k1;
+		h1 = ROTL64(h1,27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= C2; k2 = ROTL64(k2,33); k2 *= C1; h2 ^= k2;
+		h2 = ROTL64(h2,31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	tail = p;
+	k1 = k2 = 0;
+	switch (size & 15) {
+	case 15: k2 ^= (uint64_t)tail[14] << 48;
+	case 14: k2 ^= (uint64_t)tail[13] << 40;
+	case 13: k2 ^= (uint64_t)tail[12] << 32;
+	case 12: k2 ^= (uint64_t)tail[11] << 24;
+	case 11: k2 ^= (uint64_t)tail[10] << 16;
+	case 10: k2 ^= (uint64_t)tail[ 9] << 8;
+	case  9: k2 ^= (uint64_t)tail[ 8];
+		k2 *= C2; k2 = ROTL64(k2,33); k2 *= C1; h2 ^= k2;
+	case  8: k1 ^= (uint64_t)tail[ 7] << 56;
+	case  7: k1 ^= (uint64_t)tail[ 6] << 48;
+	case  6: k1 ^= (uint64_t)tail[ 5] << 40;
+	case  5: k1 ^= (uint64_t)tail[ 4] << 32;
+	case  4: k1 ^= (uint64_t)tail[ 3] << 24;
+	case  3: k1 ^= (uint64_t)tail[ 2] << 16;
+	case  2: k1 ^= (uint64_t)tail[ 1] << 8;
+	case  1: k1 ^= (uint64_t)tail[ 0];
+		k1 *= C1; k1 = ROTL64(k1,31); k1 *= C2; h1 ^= k1;
+	}
+
+	ps->digest.h1 = h1;
+	ps->digest.h2 = h2;
+	ps->len += size;
+}
+
+void
+hc_hash_final(HC_STATE *ps, HC_DIGEST *pd)
+{
+	uint64_t h1, h2;
+
+	h1 = ps->digest.h1 ^ ps->len;
+	h2 = ps->digest.h2 ^ ps->len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	pd->h1 = h1;
+	pd->h2 = h2;
+}
+
+/* the cache */
+
+void
+hc_key(HC_KEY *pk, const struct stat *pst)
+{
+	pk->dev = pst->st_dev;
+	pk->ino = pst->st_ino;
+	pk->size = pst->st_size;
+	pk->mtime = pst->st_mtime;
+	pk->ctime = pst->st_ctime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	pk->mtime_ns = pst->st_mtim.tv_nsec;
+	pk->ctime_ns = pst->st_ctim.tv_nsec;
+#else
+	pk->mtime_ns = pk->ctime_ns = 0;
+#endif
+}
+
+static unsigned int
+key_hash(const HC_KEY *pk)
+{
+	uint64_t h;
+
+	h = fmix64((uint64_t)pk->dev * 0x9e3779b97f4a7c15ULL ^ (uint64_t)pk->ino);
+	return (unsigned int)h;
+}
+
+/* return the index of the (dev,ino) slot, it is -1 if not found */
+static int *
+find_slot(const HC_KEY *pk)
+{
+	unsigned int i;
+	int e;
+
+	for (i = key_hash(pk) & slot_mask; (e = slot[i]) >= 0; i = (i + 1) & slot_mask)
+		if (entry[e].key.ino == pk->ino && entry[e].key.dev == pk->dev)
+			break;
+	return slot + i;
+}
+
+static void
+index_build(void)
+{
+	int i, size;
+
+	for (size = 64; size < 2 * cnt; size *= 2)
+		;
+	efree(slot);
+	slot = emalloc(size * sizeof(int));
+	slot_mask = size - 1;
+	for (i = 0; i < size; i++)
+		slot[i] = -1;
+	for (i = 0; i < cnt; i++)
+		*find_slot(&entry[i].key) = i;
+}
+
+static void
+entry_add(const HC_KEY *pk, const HC_DIGEST *pd, unsigned long used)
+{
+	if (cnt == alloc)
+		entry = erealloc(entry,(alloc += 1024) * sizeof(HC_ENTRY));
+	entry[cnt].key = *pk;			/* struct copy */
+	entry[cnt].digest = *pd;		/* struct copy */
+	entry[cnt].used = used;
+	cnt++;
+}
+
+static void
+hc_read(void)
+{
+	int i, tfd, split;
+	unsigned long long dev, ino, h1, h2;
+	long long size, mtime, ctime;
+	long mtime_ns, ctime_ns;
+	unsigned long used;
+	const char *line;
+	HC_KEY key;
+	HC_DIGEST digest;
+	FLAG corrupted;
+
+	tfd = fr_open(user_data.file_hc,HC_FILESIZE_LIMIT);
+	if (tfd == FR_NOFILE)
+		return;	/* missing optional file is ok */
+	if (tfd < 0) {
+		msgout(MSG_NOTICE,"COMPARE: Could not read the hash cache, it will be rebuilt");
+		return;
+	}
+	msgout(MSG_DEBUG,"COMPARE: Processing hash cache file \"%s\"",user_data.file_hc);
+
+	split = fr_split(tfd,HC_MAX);
+	if (split < 0 && split != FR_LINELIMIT) {
+		fr_close(tfd);
+		return;
+	}
+
+	for (corrupted = 0, i = 0; (line = fr_line(tfd,i)); i++) {
+		if (sscanf(line,"%llu %llu %lld %lld.%ld %lld.%ld %lu %16llx%16llx",
+		  &dev,&ino,&size,&mtime,&mtime_ns,&ctime,&ctime_ns,&used,&h1,&h2) != 10) {
+			corrupted = 1;
+			continue;
+		}
+		key.dev = dev;
+		key.ino = ino;
+		key.size = size;
+		key.mtime = mtime;
+		key.mtime_ns = mtime_ns;
+		key.ctime = ctime;
+		key.ctime_ns = ctime_ns;
+		digest.h1 = h1;
+		digest.h2 = h2;
+		entry_add(&key,&digest,used);
+		if (used >= generation)
+			generation = used + 1;
+	}
+	fr_close(tfd);
+
+	if (corrupted)
+		msgout(MSG_NOTICE,"COMPARE: Invalid lines in the hash cache file ignored");
+}
+
+static void
+hc_write(void)
+{
+	int i;
+	FILE *fp;
+	HC_ENTRY *pe;
+
+	if (user_data.nowrite || (fp = fw_open(user_data.file_hc)) == 0)
+		return;
+
+	fprintf(fp,"#\n# CLEX file content hash cache, can be deleted at any time\n#\n");
+	for (i = 0; i < cnt; i++) {
+		pe = entry + i;
+		fprintf(fp,"%llu %llu %lld %lld.%09ld %lld.%09ld %lu %016llx%016llx\n",
+		  (unsigned long long)pe->key.dev,(unsigned long long)pe->key.ino,
+		  (long long)pe->key.size,(long long)pe->key.mtime,pe->key.mtime_ns,
+		  (long long)pe->key.ctime,pe->key.ctime_ns,pe->used,
+		  (unsigned long long)pe->digest.h1,(unsigned long long)pe->digest.h2);
+	}
+	if (fw_close(fp) == 0)
+		changed = 0;
+}
+
+/* load the cache if not loaded yet, call before using the cache */
+void
+hc_load(void)
+{
+	if (!loaded) {
+		hc_read();
+		index_build();
+		loaded = 1;
+	}
+	generation++;
+}
+
+/* find the hash of a file described by the key, return 1 if found */
+int
+hc_lookup(const HC_KEY *pk, HC_DIGEST *pd)
+{
+	int e;
+	HC_ENTRY *pe;
+
+	if ((e = *find_slot(pk)) < 0)
+		return 0;
+	pe = entry + e;
+	if (pe->key.size != pk->size || pe->key.mtime != pk->mtime || pe->key.ctime != pk->ctime
+	  || pe->key.mtime_ns != pk->mtime_ns || pe->key.ctime_ns != pk->ctime_ns)
+		return 0;	/* outdated */
+	*pd = pe->digest;		/* struct copy */
+	return 1;
+}
+
+/* mark the entry found by hc_lookup() as recently used */
+void
+hc_touch(const HC_KEY *pk)
+{
+	int e;
+
+	if ((e = *find_slot(pk)) >= 0 && entry[e].used != generation) {
+		entry[e].used = generation;
+		changed = 1;
+	}
+}
+
+/* queue a new hash for hc_commit() */
+void
+hc_store(const HC_KEY *pk, const HC_DIGEST *pd)
+{
+	if (p_cnt == p_alloc)
+		pending = erealloc(pending,(p_alloc += 256) * sizeof(HC_ENTRY));
+	pending[p_cnt].key = *pk;		/* struct copy */
+	pending[p_cnt].digest = *pd;	/* struct copy */
+	pending[p_cnt].used = generation;
+	p_cnt++;
+}
+
+static int
+qcmp_used(const void *e1, const void *e2)
+{
+	unsigned long u1, u2;
+
+	u1 = ((HC_ENTRY *)e1)->used;
+	u2 = ((HC_ENTRY *)e2)->used;
+	return u1 > u2 ? -1 : u1 < u2;
+}
+
+/* add the queued hashes to the cache and save it */
+void
+hc_commit(void)
+{
+	int i, e, *ps;
+
+	for (i = 0; i < p_cnt; i++) {
+		ps = find_slot(&pending[i].key);
+		if ((e = *ps) >= 0)
+			/* replace an outdated entry */
+			entry[e] = pending[i];	/* struct copy */
+		else {
+			entry_add(&pending[i].key,&pending[i].digest,pending[i].used);
+			*ps = cnt - 1;
+			if (2 * cnt > slot_mask)
+				index_build();
+		}
+		changed = 1;
+	}
+	p_cnt = 0;
+
+	if (cnt > HC_MAX) {
+		/* drop the least recently used entries */
+		qsort(entry,cnt,sizeof(HC_ENTRY),qcmp_used);
+		cnt = HC_MAX;
+		index_build();
+	}
+
+	if (changed)
+		hc_write();
+}
@@ -0,0 +1,9 @@
+extern void hc_hash_init(HC_STATE *);
+extern void hc_hash_update(HC_STATE *, const char *, size_t);
+extern void hc_hash_final(HC_STATE *, HC_DIGEST *);
+extern void hc_key(HC_KEY *, const struct stat *);
+extern void hc_load(void);
+extern int hc_lookup(const HC_KEY *, HC_DIGEST *);
+extern void hc_touch(const HC_KEY *);
+extern void hc_store(const HC_KEY *, const HC_DIGEST *);
+extern void hc_commit(void);
@@ -26,7 +26,7 @@
 #include "inout.h"		/* win_panel() */
 #include "lex.h"		/* cmd2lex() */
 #include "log.h"		/* msgout() */
-#include "match.h"		/* match_substr() */
+#include "match.h"		/* match_substr(), match_fuzzy() */
 #include "panel.h"		/* pan_adjust() */
 #include "util.h"		/* emalloc() */
 
@@ -67,21 +67,39 @@ hist_reconfig(void)
 void
 hist_panel_data(void)
 {
-	int i, j;
+	int i, j, score;
+	FLAG fuzzy;
 	HIST_ENTRY *curs;
 
 	curs = VALID_CURSOR(panel_hist.pd) ? panel_hist.hist[panel_hist.pd->curs] : 0;
-	if (panel_hist.pd->filtering)
+	fuzzy = panel_hist.pd->filtering && FOPT(FOPT_FUZZY);
+	if (fuzzy)
+		match_fuzzy_set(panel_hist.pd->filter->line);
+	else if (panel_hist.pd->filtering)
 		match_substr_set(panel_hist.pd->filter->line);
 
 	for (i = j = 0; i < hs_cnt; i++) {
 		if (history[i] == curs)
 			panel_hist.pd->curs = j;
-		if (panel_hist.pd->filtering && !match_substr(USTR(history[i]->cmd)))
+		if (fuzzy) {
+			if ((score = match_fuzzy(USTR(history[i]->cmd))) == 0)
+				continue;
+			match_fuzzy_keep(score);
+		}
+		else if (panel_hist.pd->filtering && !match_substr(USTR(history[i]->cmd)))
 			continue;
 		panel_hist.hist[j++] = history[i];
 	}
 	panel_hist.pd->cnt = j;
+	if (fuzzy) {
+		/* best matches first */
+		match_fuzzy_sort(panel_hist.hist,j,sizeof(HIST_ENTRY *));
+		for (i = 0; i < j; i++)
+			if (panel_hist.hist[i] == curs) {
+				panel_hist.pd->curs = i;
+				break;
+			}
+	}
 }
 
 int
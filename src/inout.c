@@ -31,10 +31,12 @@
 #include "control.h"		/* get_current_mode() */
 #include "directory.h"		/* dir_split_dir() */
 #include "edit.h"			/* edit_adjust() */
+#include "list.h"			/* file_namew() */
 #include "log.h"			/* msgout() */
 #include "mbwstring.h"		/* convert2w() */
 #include "panel.h"			/* pan_adjust() */
 #include "signals.h"		/* signal_initialize() */
+#include "sort.h"			/* sort_finish() */
 #include "tty.h"			/* tty_press_enter() */
 
 #ifndef A_NORMAL
@@ -567,6 +569,8 @@ kbd_rawkey(void)
 	int retries, type;
 
 	screen_refresh();
+	/* the screen is up to date, finish the work postponed until now */
+	sort_finish();
 
 	kinp.prev_esc = kinp.fkey == 0 && kinp.key == WCH_ESC;
 	do {
@@ -1131,6 +1135,14 @@ win_filter(void)
 			label = L"( find text: ";
 			close = L" )";
 		}
+		else if (filepanel && ppanel_file->filtype == 3) {
+			label = L"< fuzzy: ";
+			close = L" >";
+		}
+		else if (filepanel && ppanel_file->filtype == 2) {
+			label = L"{ regex: ";
+			close = L" }";
+		}
 		else if (filepanel && ppanel_file->filtype) {
 			label = L"[ pattern: ";
 			close = L" ]";
@@ -1177,10 +1189,12 @@ print_fields(FILE_ENTRY *pfe, int width, const wchar_t *fields)
 {
 	const char *txt;
 	const wchar_t *wtxt;
+	const FILE_FIELDS *pff;
 	FLAG field, left_align;
 	wchar_t ch;
 	int i, fw;
 
+	pff = file_fields(pfe);
 	for (field = left_align = 0; width > 0 && (ch = *fields++); ) {
 		if (field == 0) {
 			if (ch == L'$') {
@@ -1209,25 +1223,25 @@ print_fields(FILE_ENTRY *pfe, int width, const wchar_t *fields)
 			switch (ch) {
 			case L'a':	/* access date/time */
 				fw = disp_data.date_len;
-				wtxt = pfe->atime_str;
+				wtxt = pff->atime_str;
 				break;
 			case L'd':	/* modification date/time */
 				fw = disp_data.date_len;
-				wtxt = pfe->mtime_str;
+				wtxt = pff->mtime_str;
 				break;
 			case L'g':	/* file age */
 				fw = FE_AGE_STR - 1 - ppanel_file->cw_age;
-				txt = pfe->age_str;
+				txt = pff->age_str;
 				if (txt[0])
 					txt += ppanel_file->cw_age;
 				break;
 			case L'i':	/* inode change date/time */
 				fw = disp_data.date_len;
-				wtxt = pfe->ctime_str;
+				wtxt = pff->ctime_str;
 				break;
 			case L'l':	/* links (total number) */
 				fw = FE_LINKS_STR - 1 - ppanel_file->cw_ln1;
-				txt = pfe->links_str;
+				txt = pff->links_str;
 				if (txt[0])
 					txt += ppanel_file->cw_ln1;
 				break;
@@ -1237,15 +1251,15 @@ print_fields(FILE_ENTRY *pfe, int width, const wchar_t *fields)
 				break;
 			case L'm':	/* file mode */
 				fw = FE_MODE_STR - 1;
-				txt = pfe->mode_str;
+				txt = pff->mode_str;
 				break;
 			case L'M':	/* file mode (alternative format) */
 				fw = ppanel_file->cw_mod;
-				txt = pfe->normal_mode ? "" : pfe->mode_str;
+				txt = pfe->normal_mode ? "" : pff->mode_str;
 				break;
 			case L'o':	/* owner */
 				fw = ppanel_file->cw_ow2;
-				wtxt = pfe->owner_str;
+				wtxt = pff->owner_str;
 				if (wtxt[0])
 					wtxt += ppanel_file->cw_ow1;
 				break;
@@ -1258,14 +1272,14 @@ print_fields(FILE_ENTRY *pfe, int width, const wchar_t *fields)
 				/* no break */
 			case L'p':	/* permissions */
 				fw = 9;	/* rwxrwxrwx */
-				txt = pfe->file_type == FT_NA ? "" : print_perms(pfe->mode_str);
+				txt = *pff->mode_str ? print_perms(pff->mode_str) : "";
 				break;
 			case L'r':	/* file size (or device major/minor) */
 			case L'R':
 			case L's':
 			case L'S':
 				fw = ppanel_file->cw_sz2;
-				txt = pfe->size_str;
+				txt = pff->size_str;
 				if (txt[0])
 					txt += ppanel_file->cw_sz1;
 				break;
@@ -1297,33 +1311,34 @@ print_fields(FILE_ENTRY *pfe, int width, const wchar_t *fields)
 			if (fw > width)
 				return;
 
+			/* note: the text might be longer than the field width */
 			if (txt) {
-				if (*txt == '\0')
+				if (*txt == '\0' || fw == 0)
 					/* txt == "" - leave the field blank */
 					BLANK(fw);
 				else if (left_align && *txt == ' ') {
 					/* change alignment from right to left */
-					for (i = 1; txt[i] == ' '; i++)
+					for (i = 1; i < fw && txt[i] == ' '; i++)
 						;
-					addstr(txt + i);
+					addnstr(txt + i,fw - i);
 					BLANK(i);
 				}
 				else
-					addstr(txt);
+					addnstr(txt,fw);
 			}
 			else {
-				if (*wtxt == '\0')
+				if (*wtxt == '\0' || fw == 0)
 					/* txt == "" - leave the field blank */
 					BLANK(fw);
 				else if (left_align && *wtxt == L' ') {
 					/* change alignment from right to left */
-					for (i = 1; wtxt[i] == L' '; i++)
+					for (i = 1; i < fw && wtxt[i] == L' '; i++)
 						;
-					addwstr(wtxt + i);
+					addnwstr(wtxt + i,fw - i);
 					BLANK(i);
 				}
 				else
-					addwstr(wtxt);
+					addnwstr(wtxt,fw);
 			}
 			width -= fw;
 		}
@@ -1337,7 +1352,10 @@ win_infoline(void)
     static const wchar_t
 	*info_cmp[] = {
         0, 0,
-        L"The mode is also known as access rights or permissions"
+        L"The mode is also known as access rights or permissions",
+        0, 0,
+        L"Unique files with equal data are paired regardless of their names",
+        L"Differences are listed with pathnames, files are not marked"
     },
 	*info_sort[] = {
 		0,
@@ -1386,6 +1404,8 @@ win_infoline(void)
 				addwstr(panel_compl.aux);
 			break;
 		case PANEL_TYPE_FILE:
+			/* the information about the current file is always read, see list.c */
+			filepanel_info(curs,curs + 1);
 			pfe = ppanel_file->files[curs];
 			if (pfe->file_type == FT_NA)
 				msg = L"no status information available";
@@ -1657,6 +1677,8 @@ draw_line_cmp(int ln)
 		L"compare file mode",
 		L"compare file ownership (user and group)",
 		L"compare file data (contents)",
+		L"detect renamed files (requires data comparison)",
+		L"compare subdirectories recursively",
 		L"--> Compare name, type and attributes selected above"
 	};
 
@@ -1671,17 +1693,22 @@ draw_line_cmp_sum(int ln)
 	static const wchar_t *description[] = {
 		L"total number of files in panels",
 		L"\\_ UNIQUE FILENAMES         ",
+		L"\\_ renamed  ",	/* line #2 is hidden if renamed files were not detected */
 		L"\\_ pairs of files compared  ",
 		L"\\_ DIFFERING",
-		L"\\_ ERRORS   ",	/* line #4 is hidden if there are no errors */
-		L"\\_ equal    "
+		L"\\_ ERRORS   ",	/* line #5 is hidden if there are no errors */
+		L"\\_ equal    ",
+		L"hashes found in the cache"	/* line #7 is hidden if the cache was not used */
 	};
 	wchar_t *txt, buf[64];
-	int p1, p2;
+	int i, p1, p2;
 	FLAG marked;
 
-	if (ln >= 4 && panel->cnt != ARRAY_SIZE(description))
-		ln++;
+	/* skip the hidden lines */
+	for (i = 0; i <= ln; i++)
+		if ((i == 2 && !panel_cmp_sum.renames) || (i == 5 && !panel_cmp_sum.errors)
+		  || (i == 7 && !panel_cmp_sum.hc_lookups))
+			ln++;
 
 	txt = buf;
 	marked = 0;
@@ -1701,22 +1728,28 @@ draw_line_cmp_sum(int ln)
 			txt = L"     -";
 		break;
 	case 2:
-		swprintf(txt,ARRAY_SIZE(buf),L"  %4d",panel_cmp_sum.names);
+		swprintf(txt,ARRAY_SIZE(buf),L"%4d + %d",panel_cmp_sum.renamed1,panel_cmp_sum.renamed2);
 		break;
 	case 3:
+		swprintf(txt,ARRAY_SIZE(buf),L"  %4d",panel_cmp_sum.names);
+		break;
+	case 4:
 		p1 = panel_cmp_sum.names - panel_cmp_sum.equal - panel_cmp_sum.errors;
 		if ( (marked = p1 > 0) )
 			swprintf(txt,ARRAY_SIZE(buf),L"  %4d",p1);
 		else
 			txt = L"     -";
 		break;
-	case 4:
+	case 5:
 		swprintf(txt,ARRAY_SIZE(buf),L"  %4d",panel_cmp_sum.errors);
 		marked = 1;
 		break;
-	case 5:
+	case 6:
 		swprintf(txt,ARRAY_SIZE(buf),L"  %4d",panel_cmp_sum.equal);
 		break;
+	case 7:
+		swprintf(txt,ARRAY_SIZE(buf),L"  %4d of %d",panel_cmp_sum.hc_hits,panel_cmp_sum.hc_lookups);
+		break;
 	}
 	BLANK(32 - wc_cols(description[ln],0,-1));
 	addwstr(description[ln]);
@@ -1728,6 +1761,31 @@ draw_line_cmp_sum(int ln)
 		attroff(attrb);
 }
 
+void
+draw_line_cmp_tree(int ln)
+{
+	static const wchar_t *description[] = {
+		L"only in #1 ",
+		L"only in #2 ",
+		L"file type  ",
+		L"size       ",
+		L"mode       ",
+		L"ownership  ",
+		L"data       ",
+		L"ERROR      "
+	};
+	CMP_DIFF *pd;
+	FLAG marked;
+
+	pd = panel_cmp_tree.diff + ln;
+	if ( (marked = pd->reason == DIFF_ERROR) )
+		attron(attrb);
+	addwstr(description[pd->reason]);
+	if (marked)
+		attroff(attrb);
+	putwcs_trunc(pd->pathw,disp_data.pancols - wc_cols(description[pd->reason],0,-1),0);
+}
+
 void
 draw_line_compl(int ln)
 {
@@ -1777,17 +1835,19 @@ draw_line_file(int ln)
 	FILE_ENTRY *pfe;
 
 	pfe = ppanel_file->files[ln];
+	if (pfe->pending && disp_data.layout_info)
+		filepanel_info(ln,ln + 1);
 	if (pfe->select && !pfe->dotdir)
 		attron(attrb);
 
 	/* 10 columns reserved for the filename */
 	print_fields(pfe,disp_data.pancols - 10,disp_data.layout_panel);
 	if (!pfe->symlink)
-		putwcs_trunc_col(SDSTR(pfe->filew),disp_data.panrcol,0);
+		putwcs_trunc_col(file_namew(pfe),disp_data.panrcol,0);
 	else {
-		putwcs_trunc_col(SDSTR(pfe->filew),disp_data.panrcol,OPT_NOPAD);
+		putwcs_trunc_col(file_namew(pfe),disp_data.panrcol,OPT_NOPAD);
 		putwcs_trunc_col(L" -> ",disp_data.panrcol,OPT_NOPAD);
-		putwcs_trunc_col(USTR(pfe->linkw),disp_data.panrcol,0);
+		putwcs_trunc_col(pfe->extra->linkw,disp_data.panrcol,0);
 	}
 
 	if (pfe->select)
@@ -1801,6 +1861,8 @@ draw_line_fopt(int ln)
 		L"substring matching: ignore the case of the characters",
 		L"pattern matching: wildcards match the dot in hidden .files",
 		L"file panel filtering: always show directories",
+		L"file panel filtering: use regular expressions",
+		L"substring matching: fuzzy, best matches first",
 		/* must correspond with FOPT_XXX */
 	};
 
@@ -2111,6 +2173,12 @@ draw_panel(int optimize)
 	}
 	else {
 		posctl.update = 1;
+		if (panel->type == PANEL_TYPE_FILE && ppanel_file->partial
+		  && panel->top + disp_data.panlines > ppanel_file->partial)
+			sort_finish();
+		/* read the missing file information for all lines at once */
+		if (panel->type == PANEL_TYPE_FILE && disp_data.layout_info)
+			filepanel_info(panel->top,panel->top + disp_data.panlines);
 		/* redraw all lines */
 		for (curs = panel->top; curs < panel->top + disp_data.panlines; curs++)
 			draw_panel_line(curs);
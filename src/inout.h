@@ -32,6 +32,7 @@ extern void draw_line_cfg(int);
 extern void draw_line_cfg_menu(int);
 extern void draw_line_cmp(int);
 extern void draw_line_cmp_sum(int);
+extern void draw_line_cmp_tree(int);
 extern void draw_line_compl(int);
 extern void draw_line_dir(int);
 extern void draw_line_dir_split(int);
@@ -15,11 +15,13 @@
 #include "clexheaders.h"
 
 #include <sys/stat.h>		/* stat() */
+#include <sys/time.h>		/* gettimeofday() */
 #include <wctype.h>			/* iswprint() */
 #include <dirent.h>			/* readdir() */
 #include <errno.h>			/* errno */
 #include <stdarg.h>			/* log.h */
 #include <stdio.h>			/* sprintf() */
+#include <stdlib.h>			/* malloc() */
 #include <string.h>			/* strcmp() */
 #include <time.h>			/* time() */
 #include <unistd.h>			/* stat() */
@@ -47,14 +49,18 @@
 #include "log.h"			/* msgout() */
 #include "match.h"			/* match_pattern_set() */
 #include "mbwstring.h"		/* convert2w() */
+#include "panel.h"			/* pan_adjust() */
+#include "signals.h"		/* signal_ctrlc_on() */
 #include "sort.h"			/* sort_files() */
+#include "uring.h"			/* uring_stat() */
 #include "userdata.h"		/* lookup_login() */
-#include "ustringutil.h"	/* us_readlink() */
 #include "util.h"			/* emalloc() */
+#include "watch.h"			/* watch_read() */
+#include "workers.h"		/* work_submit() */
 
 /*
- * additional FILE_ENTRIES to be allocated when the file panel is full,
- * i.e. when all existing entries in 'all_files' are occupied
+ * additional 'all_files' pointers to be allocated when the file panel
+ * is full; the FILE_ENTRies themselves are allocated in the panel's arena
  */
 #define FE_ALLOC_UNIT	128
 
@@ -85,16 +91,52 @@ static const wchar_t *td_fmt[3];	/* time/date formats (man strftime, man wcsftim
 static int td_pad[3], td_len[3];	/* time/date padding + output string lengths */
 									/* padding + length = disp_data.date_len */
 static const wchar_t *td_fmt_fail;	/* failed time/date output format */
+static FLAG td_fmt_reported;		/* td_fmt_fail was reported in the current listing */
 
 #define FAILSAFE_TIME		L"%H:%M"
 #define FAILSAFE_DATE		L"%Y-%m-%d"
 #define FAILSAFE_TIMEDATE	L"%H:%M %Y-%m-%d"
 #define FAILSAFE_DATETIME	L"%Y-%m-%d %H:%M"
 
+/* formatted file information, see file_fields() */
+#define FMT_CACHE_SIZE	128
+static struct {
+	const FILE_ENTRY *pfe;
+	unsigned int gen;
+	FILE_FIELDS ff;
+} fmt_cache[FMT_CACHE_SIZE];
+static unsigned int fmt_gen = 1;	/* increment to invalidate the cache */
+
 /* directory listing */
 static FLAG mm_change;				/* minor/major format changed during the operation */
 static FLAG use_pathname = 0;		/* hack for listing a directory other than the cwd */
-static dev_t dirdev;				/* filesystem device of the inspected directory */
+static FLAG full_info = 0;			/* do not postpone reading of the file information */
+
+/* stat_file() return values */
+#define STAT_OK			0	/* file information is available */
+#define STAT_NOINFO		1	/* file exists, but no other information is available */
+#define STAT_GONE		2	/* file deleted in the meantime */
+
+/*
+ * file information is read by worker threads in batches, see describe_file();
+ * emalloc() must not be called in a worker thread, because it terminates
+ * the program on failure, the jobs use malloc() and report a failure
+ * as STAT_NOINFO
+ */
+#define STAT_BATCH_SIZE	64	/* entries in one batch */
+#define STAT_BATCHES	32	/* max. batches submitted at once */
+typedef struct {
+	const char *dir;				/* directory with a trailing slash or null for cwd */
+	int cnt;						/* number of entries */
+	FILE_ENTRY *pfe[STAT_BATCH_SIZE];
+	CODE status[STAT_BATCH_SIZE];	/* STAT_XXX */
+	struct stat st[STAT_BATCH_SIZE];
+	char *link[STAT_BATCH_SIZE];	/* symbolic link targets (malloc()-ed) or null */
+} STAT_BATCH;
+static STAT_BATCH *batch = 0;
+static int batch_cnt = 0;			/* number of submitted batches */
+static WORK_GROUP stat_group;
+static const char *stat_dir;		/* value for STAT_BATCH.dir */
 
 static int
 check_str(const wchar_t *str)
@@ -193,6 +235,8 @@ td_fmt_reconfig(void)
 		}
 	}
 
+	td_fmt_fail = 0;
+	fmt_gen++;
 	if (fmt_fail)
 		msgout(MSG_w,"Problem with time/date output format, details in log");
 }
@@ -209,6 +253,7 @@ kb_reconfig(void)
 		K2 = 512;
 		K995 = 10189;
 	}
+	fmt_gen++;
 }
 
 /* split layout to panel fields and line fields */
@@ -274,6 +319,18 @@ layout_reconfig(void)
 			/* default: ignore unknown formatting character */
 			}
 		}
+
+	fmt_gen++;
+
+	/* symbolic links are always detected, see directory_read() */
+	disp_data.layout_info = 0;
+	for (field = 0, layout = disp_data.layout_panel; (ch = *layout++); )
+		if (!TCLR(field)) {
+			if (ch == L'$')
+				field = 1;
+		}
+		else if (wcschr(L">*$|",ch) == 0)
+			disp_data.layout_info = 1;
 }
 
 void
@@ -312,12 +369,9 @@ stat2time(wchar_t *str, time_t tm)
 		else
 			td = localtime(&tm)->tm_mday != now_day ? TD_DATE: TD_TIME;
 	}
-	else {
-		if (tm > now + 300	/* 5 minutes tolerance */)
-			future = 1;
+	else
 		td = (tm > now + 86400 || localtime(&tm)->tm_mday != now_day) ? TD_DATE: TD_TIME;
-	}
-	
+
 	for (i = 0; i < td_pad[td]; i++)
 		*str++ = L' ';
 	len = wcsftime(str,FE_TIME_STR - td_pad[td],td_fmt[td],localtime(&tm));
@@ -444,44 +498,46 @@ stat2size_3(char *str, off_t size)
 #define MIN_MINOR_DIGITS	2
 #define MAX_MINOR_DIGITS	7
 
+static unsigned int digits_minor[] = {
+  0,
+  0xF,
+  0xFF,		/* 2 digits,  8 bits */
+  0xFFF,	/* 3 digits, 12 bits */
+  0xFFFF,	/* 4 digits, 16 bits */
+  0xFFFFF,	/* 5 digits, 20 bits */
+  0xFFFFFF,	/* 6 digits, 24 bits */
+  0xFFFFFFF,/* 7 digits, 28 bits */
+  0xFFFFFFFF
+};
+static unsigned int digits_major[] = {
+  0,
+  9,
+  99,
+  999, 		/* 3 digits,  9 bits */
+  9999,		/* 4 digits, 13 bits */
+  99999,	/* 5 digits, 16 bits */
+  999999,	/* 6 digits, 19 bits */
+  9999999,	/* 7 digits, 23 bits */
+  99999999, /* 8 digits, 26 bits */
+  999999999
+};
+static int minor_len = MIN_MINOR_DIGITS;
+static int major_len = FE_SIZE_DEV_STR - MIN_MINOR_DIGITS - 2;
+
+/* determine the major digits / minor digits split */
 static void
-stat2dev(char *str, unsigned int dev_major, unsigned int dev_minor)
+dev_split(unsigned int dev_minor)
 {
-	static unsigned int digits_minor[] = {
-	  0,
-	  0xF,
-	  0xFF,		/* 2 digits,  8 bits */
-	  0xFFF,	/* 3 digits, 12 bits */
-	  0xFFFF,	/* 4 digits, 16 bits */
-	  0xFFFFF,	/* 5 digits, 20 bits */
-	  0xFFFFFF,	/* 6 digits, 24 bits */
-	  0xFFFFFFF,/* 7 digits, 28 bits */
-	  0xFFFFFFFF
-	};
-	static unsigned int digits_major[] = {
-      0,
-	  9,
-	  99,
-	  999, 		/* 3 digits,  9 bits */
-	  9999,		/* 4 digits, 13 bits */
-	  99999,	/* 5 digits, 16 bits */
-	  999999,	/* 6 digits, 19 bits */
-	  9999999,	/* 7 digits, 23 bits */
-	  99999999, /* 8 digits, 26 bits */
-	  999999999
-	};
-	static int minor_len = MIN_MINOR_DIGITS;
-	static int major_len = FE_SIZE_DEV_STR - MIN_MINOR_DIGITS - 2;
-	int minor_of;	/* overflow */
-
-	/* determine the major digits / minor digits split */
-	while ( (minor_of = dev_minor > digits_minor[minor_len])
-	  && minor_len < MAX_MINOR_DIGITS) {
+	while (dev_minor > digits_minor[minor_len] && minor_len < MAX_MINOR_DIGITS) {
 		minor_len++;
 		major_len--;
 		mm_change = 1;
 	}
+}
 
+static void
+stat2dev(char *str, unsigned int dev_major, unsigned int dev_minor)
+{
 	/* print major */
 	if (dev_major > digits_major[major_len])
 		sprintf(str,"%*s",major_len,"..");
@@ -489,7 +545,7 @@ stat2dev(char *str, unsigned int dev_major, unsigned int dev_minor)
 		sprintf(str,"%*d",major_len,dev_major);
 
 	/* print minor */
-	if (minor_of)
+	if (dev_minor > digits_minor[minor_len])
 		sprintf(str + major_len,":..%0*X",
 		  minor_len - 2,dev_minor & digits_minor[minor_len - 2]);
 	else
@@ -525,8 +581,8 @@ stat2type(mode_t mode, uid_t uid)
 	return FT_OTHER;
 }
 
-/* format for the file panel */
-static void
+/* format for the file panel, return value: number of characters without padding */
+static int
 id2name(wchar_t *dst, int leftalign, const wchar_t *name, unsigned int id)
 {
 	int i, len, pad;
@@ -550,74 +606,85 @@ id2name(wchar_t *dst, int leftalign, const wchar_t *name, unsigned int id)
 				*dst++ = L' ';
 			*dst = L'\0';
 		}
+		return len;
 	}
-	else {
-		for (i = 0 ; i < (FE_NAME_STR - 1) / 2; i++)
-			*dst++ = name[i];
-		*dst++ = L'>';
-		for (i = len - FE_NAME_STR / 2 + 1; i <= len ;i++)
-			*dst++ = name[i];
-	}
+
+	for (i = 0 ; i < (FE_NAME_STR - 1) / 2; i++)
+		*dst++ = name[i];
+	*dst++ = L'>';
+	for (i = len - FE_NAME_STR / 2 + 1; i <= len ;i++)
+		*dst++ = name[i];
+	return FE_NAME_STR - 1;
 }
 
+/* 'plen' (if not null) receives the name length */
 static const wchar_t *
-uid2name(uid_t uid)
+uid2name(uid_t uid, int *plen)
 {
 	static int pos = 0, replace = 0;
 	static struct {
 		uid_t uid;
+		int len;
 		wchar_t name[FE_NAME_STR];
 	} cache[CACHE_SIZE];
 
 	if (pos < ucache_cnt && uid == cache[pos].uid)
-		return cache[pos].name;
+		goto found;
 
 	for (pos = 0; pos < ucache_cnt; pos++)
 		if (uid == cache[pos].uid)
-			return cache[pos].name;
+			goto found;
 
 	if (ucache_cnt < CACHE_SIZE)
 		pos = ucache_cnt++;
 	else
 		pos = replace = (replace + CACHE_REPL) % CACHE_SIZE;
 	cache[pos].uid = uid;
-	id2name(cache[pos].name,0,lookup_login(uid),(unsigned int)uid);
+	cache[pos].len = id2name(cache[pos].name,0,lookup_login(uid),(unsigned int)uid);
 
+found:
+	if (plen)
+		*plen = cache[pos].len;
 	return cache[pos].name;
 }
 
+/* 'plen' (if not null) receives the name length */
 static const wchar_t *
-gid2name(gid_t gid)
+gid2name(gid_t gid, int *plen)
 {
 	static int pos = 0, replace = 0;
 	static struct {
 		gid_t gid;
+		int len;
 		wchar_t name[FE_NAME_STR];
 	} cache[CACHE_SIZE];
 
 	if (pos < gcache_cnt && gid == cache[pos].gid)
-		return cache[pos].name;
+		goto found;
 
 	for (pos = 0; pos < gcache_cnt; pos++)
 		if (gid == cache[pos].gid)
-			return cache[pos].name;
+			goto found;
 
 	if (gcache_cnt < CACHE_SIZE)
 		pos = gcache_cnt++;
 	else
 		pos = replace = (replace + CACHE_REPL) % CACHE_SIZE;
 	cache[pos].gid = gid;
-	id2name(cache[pos].name,1,lookup_group(gid),(unsigned int)gid);
+	cache[pos].len = id2name(cache[pos].name,1,lookup_group(gid),(unsigned int)gid);
 
+found:
+	if (plen)
+		*plen = cache[pos].len;
 	return cache[pos].name;
 }
 
 static void
 stat2owner(wchar_t *str, uid_t uid, gid_t gid)
 {
-		wcscpy(str,uid2name(uid));
+		wcscpy(str,uid2name(uid,0));
 		str[FE_NAME_STR - 1] = L':';
-		wcscpy(str + FE_NAME_STR,gid2name(gid));
+		wcscpy(str + FE_NAME_STR,gid2name(gid,0));
 }
 
 static void
@@ -648,183 +715,737 @@ get_ext(const char *filename)
 	return ext;
 }
 
+/* return the FILE_EXTRA data of 'pfe', allocate it if necessary */
+static FILE_EXTRA *
+file_extra(FILE_ENTRY *pfe)
+{
+	FILE_EXTRA *px;
+
+	if ( (px = pfe->extra) )
+		return px;
+
+	px = pfe->extra = arena_alloc(&ppanel_file->arena,sizeof(FILE_EXTRA));
+	px->filew = px->filelc = 0;
+	px->charmask = 0;
+	px->link = 0;
+	px->linkw = 0;
+	px->devnum = 0;
+	px->atime = px->ctime = 0;
+	px->nlink = 0;
+	return px;
+}
+
+/* return the file name converted to wchar, 'pfe' must be in the current file panel */
+const wchar_t *
+file_namew(FILE_ENTRY *pfe)
+{
+	FILE_EXTRA *px;
+
+	px = file_extra(pfe);
+	if (!pfe->namew) {
+		px->filew = arena_wcsdup(&ppanel_file->arena,convert2w(pfe->file));
+		pfe->namew = 1;
+	}
+	return px->filew;
+}
+
+/*
+ * like file_namew(), but without allocating the FILE_EXTRA,
+ * the result is valid until the next call
+ */
+static const wchar_t *
+tmp_namew(const FILE_ENTRY *pfe)
+{
+	return pfe->namew ? pfe->extra->filew : convert2w(pfe->file);
+}
+
+/* lowercase file name for the case insensitive filter, computed only once */
+static const wchar_t *
+file_namelc(FILE_ENTRY *pfe)
+{
+	const wchar_t *p;
+	FILE_EXTRA *px;
+
+	px = file_extra(pfe);
+	if (px->filelc == 0) {
+		for (p = file_namew(pfe); *p != L'\0' && !iswupper(*p); p++)
+			;
+		/* most names are lowercase already */
+		px->filelc = *p == L'\0' ? px->filew
+		  : match_lowercase(arena_wcsdup(&ppanel_file->arena,px->filew));
+		px->charmask = match_charmask(px->filelc);
+	}
+	return px->filelc;
+}
+
+/* fuzzy match score of the file name or the symbolic link, 0 = no match */
+static int
+file_fuzzy(FILE_ENTRY *pfe)
+{
+	int score, lscore;
+	const wchar_t *lc;
+
+	lc = file_namelc(pfe);
+	score = match_fuzzy_lc(pfe->extra->filew,lc,pfe->extra->charmask);
+	if (pfe->symlink && (lscore = match_fuzzy(pfe->extra->linkw)) > score)
+		score = lscore;
+	return score;
+}
+
+/* change the name of an entry in the current file panel */
+void
+file_rename(FILE_ENTRY *pfe, const char *name)
+{
+	pfe->file = arena_strdup(&ppanel_file->arena,name);
+	pfe->extension = get_ext(pfe->file);
+	pfe->collkey = 0;
+	pfe->namew = 0;
+	if (pfe->extra)
+		pfe->extra->filelc = 0;
+	ppanel_file->list_gen++;
+}
+
+/* allocate a new entry in the current file panel */
+static FILE_ENTRY *
+entry_new(const char *name)
+{
+	FILE_ENTRY *pfe;
+
+	pfe = arena_alloc(&ppanel_file->arena,sizeof(FILE_ENTRY));
+	pfe->file = arena_strdup(&ppanel_file->arena,name);
+	pfe->collkey = 0;
+	pfe->extra = 0;
+	pfe->namew = 0;
+	return pfe;
+}
+
 /* this file does exist, but no other information is available */
 static void
 nofileinfo(FILE_ENTRY *pfe)
 {
 	pfe->mtime = 0;
 	pfe->size = 0;
-	pfe->extension = get_ext(SDSTR(pfe->file));
+	pfe->extension = get_ext(pfe->file);
 	pfe->file_type = FT_NA;
-	pfe->size_str[0] = '\0';
-	pfe->atime_str[0] = L'\0';
-	pfe->mtime_str[0] = L'\0';
-	pfe->ctime_str[0] = L'\0';
-	pfe->links_str[0] = '\0';
-	pfe->age_str[0] = '\0';
 	pfe->links = 0;
-	pfe->mode_str[0] = '\0';
 	pfe->normal_mode = 1;
-	pfe->owner_str[0] = L'\0';
 }
 
-/* fill-in all required information about a file */
+/*
+ * fill-in all required information about a file
+ *
+ * only the raw data is stored here, the output strings
+ * are produced when needed by file_fields()
+ */
 static void
 fileinfo(FILE_ENTRY *pfe, struct stat *pst)
 {
+	FILE_EXTRA *px;
+
 	pfe->mtime = pst->st_mtime;
 	pfe->size = pst->st_size;
-	pfe->extension = get_ext(SDSTR(pfe->file));
+	pfe->extension = get_ext(pfe->file);
 	pfe->file_type = stat2type(pst->st_mode,pst->st_uid);
 	if (IS_FT_DEV(pfe->file_type))
 #ifdef HAVE_STRUCT_STAT_ST_RDEV
-		pfe->devnum = pst->st_rdev;
+		file_extra(pfe)->devnum = pst->st_rdev;
 #else
-		pfe->devnum = 0;
+		file_extra(pfe)->devnum = 0;
 #endif
+	if (do_a || do_i || do_l) {
+		px = file_extra(pfe);
+		px->atime = pst->st_atime;
+		px->ctime = pst->st_ctime;
+		px->nlink = pst->st_nlink;
+	}
 	/* special case: active mounting point */
 	if (pfe->file_type == FT_DIRECTORY && !pfe->symlink
-	  && !pfe->dotdir && pst->st_dev != dirdev)
+	  && !pfe->dotdir && pst->st_dev != ppanel_file->dirdev)
 		pfe->file_type = FT_DIRECTORY_MNT;
 
-	if (do_a)
-		stat2time(pfe->atime_str,pst->st_atime);
-	if (do_d)
-		stat2time(pfe->mtime_str,pst->st_mtime);
-	if (do_g)
-		stat2age(pfe->age_str,pst->st_mtime);
-	if (do_i)
-		stat2time(pfe->ctime_str,pst->st_ctime);
-	if (do_l)
-		stat2links(pfe->links_str,pst->st_nlink);
+	/* 5 minutes tolerance */
+	if ((do_a && pst->st_atime > now + 300) || (do_d && pst->st_mtime > now + 300)
+	  || (do_i && pst->st_ctime > now + 300))
+		future = 1;
 	if (do_L)
 		pfe->links = pst->st_nlink > 1 && !IS_FT_DIR(pfe->file_type);
 	pfe->mode12 = pst->st_mode & 07777;
-	if (do_m) {
-		sprintf(pfe->mode_str,"%04o",pfe->mode12);
-		if (do_m_blank) {
-			if (S_ISREG(pst->st_mode))
-				pfe->normal_mode = pfe->mode12 == normal_file
-				  || pfe->mode12 == normal_dir /* same as exec */;
-			else if (S_ISDIR(pst->st_mode))
-				pfe->normal_mode = pfe->mode12 == normal_dir;
-			else
-				pfe->normal_mode = pfe->mode12 == normal_file;
-		}
+	if (do_m_blank) {
+		if (S_ISREG(pst->st_mode))
+			pfe->normal_mode = pfe->mode12 == normal_file
+			  || pfe->mode12 == normal_dir /* same as exec */;
+		else if (S_ISDIR(pst->st_mode))
+			pfe->normal_mode = pfe->mode12 == normal_dir;
+		else
+			pfe->normal_mode = pfe->mode12 == normal_file;
 	}
 	pfe->uid = pst->st_uid;
 	pfe->gid = pst->st_gid;
+	if (do_s && IS_FT_DEV(pfe->file_type))
+		dev_split(minor(pfe->extra->devnum));
+}
+
+/*
+ * return the formatted file information of the entry 'pfe'
+ * in the current file panel
+ *
+ * The strings are produced on demand and kept in a small cache,
+ * only the visible entries are usually formatted. The returned
+ * data is valid until the next call.
+ */
+const FILE_FIELDS *
+file_fields(const FILE_ENTRY *pfe)
+{
+	int slot;
+	FILE_FIELDS *pff;
+	const FILE_EXTRA *px;
+
+	slot = ((size_t)pfe / sizeof(FILE_ENTRY)) % FMT_CACHE_SIZE;
+	pff = &fmt_cache[slot].ff;
+	if (fmt_cache[slot].pfe == pfe && fmt_cache[slot].gen == fmt_gen)
+		return pff;
+	fmt_cache[slot].pfe = pfe;
+	fmt_cache[slot].gen = fmt_gen;
+
+	pff->atime_str[0] = pff->mtime_str[0] = pff->ctime_str[0] = pff->owner_str[0] = L'\0';
+	pff->age_str[0] = pff->links_str[0] = pff->mode_str[0] = pff->size_str[0] = '\0';
+	if (pfe->pending || pfe->file_type == FT_NA)
+		return pff;
+
+	/* the file panel shows the file information as of the listing time */
+	if (now != ppanel_file->timestamp) {
+		now = ppanel_file->timestamp;
+		now_day = localtime(&now)->tm_mday;
+	}
+
+	/* 'px' might be null only if the layout has changed and the panel was not re-read yet */
+	px = pfe->extra;
+	if (do_a && px)
+		stat2time(pff->atime_str,px->atime);
+	if (do_d)
+		stat2time(pff->mtime_str,pfe->mtime);
+	if (do_g)
+		stat2age(pff->age_str,pfe->mtime);
+	if (do_i && px)
+		stat2time(pff->ctime_str,px->ctime);
+	if (do_l && px)
+		stat2links(pff->links_str,px->nlink);
+	if (do_m)
+		sprintf(pff->mode_str,"%04o",pfe->mode12);
 	if (do_o)
-		stat2owner(pfe->owner_str,pst->st_uid,pst->st_gid);
+		stat2owner(pff->owner_str,pfe->uid,pfe->gid);
 	if (do_s) {
 		if (IS_FT_DEV(pfe->file_type))
-			stat2dev(pfe->size_str,major(pfe->devnum),minor(pfe->devnum));
+			stat2dev(pff->size_str,major(px->devnum),minor(px->devnum));
 		else if (do_s_nodir && IS_FT_DIR(pfe->file_type))
 			/* stat2size_blank() - blank x FE_SIZE_DEV_STR */
-			strcpy(pfe->size_str,"           ");
+			strcpy(pff->size_str,"           ");
 		else
 			(do_s_short ? stat2size_3 : stat2size_7)
-			  (pfe->size_str,pst->st_size);
+			  (pff->size_str,pfe->size);
 	}
+
+	return pff;
+}
+
+/* number of decimal digits */
+static int
+digits(unsigned long int num)
+{
+	int d;
+
+	for (d = 1; num > 9; d++)
+		num /= 10;
+	return d;
 }
 
-/* set column widths */
+/* output width of the stat2age() string */
+static int
+age_width(time_t tm)
+{
+	time_t age;
+	int h, m, s;
+
+	age = now - tm;
+	if (age < 0)
+		return 7;	/* "future!" */
+	if (age >= 360000 /* 100 hours */)
+		return 0;
+	h = age / 3600;
+	age -= h * 3600;
+	m = age / 60;
+	s = age - m * 60;
+	if (h)
+		return digits(h) + 7;	/* "-h:mm:ss" */
+	if (m)
+		return digits(m) + 4;	/* "-m:ss" */
+	if (s)
+		return digits(s) + 1;	/* "-s" */
+	return 2;					/* "-0" */
+}
+
+/*
+ * output width of the stat2size_3() or stat2size_7() number,
+ * 'pexp' receives the exponent (0 = no unit)
+ */
+static int
+size_width(off_t size, int *pexp)
+{
+	int d, exp, roundup;
+	FLAG dp;	/* decimal point */
+
+	if (do_s_short) {
+		for (exp = roundup = 0, dp = 0; size + roundup > 999; exp++) {
+			if ( (dp = size < K995) )
+				size *= 10;
+			size /= K2;
+			roundup = size % 2;
+			size /= 2;
+		}
+		*pexp = exp;
+		return dp ? 3 : digits(size + roundup);
+	}
+
+	for (exp = roundup = 0; size + roundup > 9999999 /* 9.999.999 */; exp++) {
+		size /= K2;
+		roundup = size % 2;
+		size /= 2;
+	}
+	*pexp = exp;
+	d = digits(size + roundup);
+	/* with thousands separators */
+	return d + (d > 3) + (d > 6);
+}
+
+/*
+ * column widths are adjusted by cw_update() for each entry with
+ * the file information, the widths can only grow (the file panel
+ * might show entries with the file information read later)
+ *
+ * The widths are computed from the raw data, the results are the same
+ * as if the leading and trailing spaces in the strings produced by
+ * file_fields() were counted.
+ */
 static void
-set_cw(void)
+cw_reset(void)
 {
-	int i, mod, lns, lnh, ln1, sz1, ow1, sz2, ow2, age;
-	FILE_ENTRY *pfe;
+	ppanel_file->cw_mod = do_m_blank ? 0 : FE_MODE_STR - 1;
+	ppanel_file->cw_lns = do_gt ? 0 : 2;	/* strlen("->")  */
+	ppanel_file->cw_lnh = do_L ? 0 : 3;		/* strlen("LNK") */
+	ppanel_file->cw_ln1 = FE_LINKS_STR - 2;
+	ppanel_file->cw_sz1 = FE_SIZE_DEV_STR - 3;
+	ppanel_file->cw_ow1 = FE_NAME_STR - 2;
+	ppanel_file->cw_age = FE_AGE_STR - 1;
+	ppanel_file->cw_sz2 = 0;
+	ppanel_file->cw_ow2 = 3;
+}
 
-	mod = do_m_blank;
-	lns = do_gt;
-	lnh = do_L;
-	age = FE_AGE_STR - 2;
-	ln1 = FE_LINKS_STR - 3;
-	sz1 = FE_SIZE_DEV_STR - 4;
-	ow1 = FE_NAME_STR - 3;
-	sz2 = FE_SIZE_DEV_STR - 3;
-	ow2 = FE_NAME_STR + 1;
-
-	for (i = 0; i < ppanel_file->all_cnt; i++) {
-		pfe = ppanel_file->all_files[i];
-		if (mod && !pfe->normal_mode)
-			mod = 0;
-		if (lns && pfe->symlink)
-			lns = 0;
-		if (lnh && pfe->links)
-			lnh = 0;
-		if (do_g && *pfe->age_str)
-			while (age >= 0 && pfe->age_str[age] != ' ')
-				age--;
-		if (do_l && *pfe->links_str)
-			while (ln1 >= 0 && pfe->links_str[ln1] != ' ')
-				ln1--;
-		if (do_s && *pfe->size_str) {
-			while (sz1 >= 0 && pfe->size_str[sz1] != ' ')
-				sz1--;
-			while (sz2 < FE_SIZE_DEV_STR - 1 && pfe->size_str[sz2] != ' ')
-				sz2++;
+#define CW_SHRINK(CW,VAL)	do { if ((VAL) < (CW)) (CW) = (VAL); } while (0)
+#define CW_GROW(CW,VAL)		do { if ((VAL) > (CW)) (CW) = (VAL); } while (0)
+
+static void
+cw_update(FILE_ENTRY *pfe)
+{
+	int w, exp, end, sz2, ow2, ulen, glen;
+	unsigned int dev_major;
+
+	if (!pfe->normal_mode)
+		ppanel_file->cw_mod = FE_MODE_STR - 1;
+	if (pfe->symlink)
+		ppanel_file->cw_lns = 2;
+	if (pfe->links)
+		ppanel_file->cw_lnh = 3;
+	if (pfe->file_type == FT_NA)
+		return;
+	if (do_g)
+		CW_SHRINK(ppanel_file->cw_age,FE_AGE_STR - 1 - age_width(pfe->mtime));
+	if (do_l) {
+		w = pfe->extra->nlink <= 999 ? digits(pfe->extra->nlink) : 3 /* "max" */;
+		CW_SHRINK(ppanel_file->cw_ln1,FE_LINKS_STR - 1 - w);
+	}
+	if (do_s && !(do_s_nodir && IS_FT_DIR(pfe->file_type))) {
+		/* cw_sz2 is relative to cw_sz1 */
+		sz2 = ppanel_file->cw_sz1 + ppanel_file->cw_sz2;
+		if (IS_FT_DEV(pfe->file_type)) {
+			dev_major = major(pfe->extra->devnum);
+			w = dev_major > digits_major[major_len] ? 2 /* ".." */ : digits(dev_major);
+			CW_SHRINK(ppanel_file->cw_sz1,major_len - w);
+			sz2 = FE_SIZE_DEV_STR - 1;
 		}
-		if (do_o && *pfe->owner_str) {
-			while (ow1 >= 0 && pfe->owner_str[ow1] != L' ')
-				ow1--;
-			while (ow2 < FE_OWNER_STR - 1 && pfe->owner_str[ow2] != L' ')
-				ow2++;
+		else {
+			/* position of the last digit, see stat2size_3() and stat2size_7() */
+			end = K2 == 512 ? 8 : 9;
+			w = size_width(pfe->size,&exp);
+			CW_SHRINK(ppanel_file->cw_sz1,end + 1 - w);
+			CW_GROW(sz2,exp ? FE_SIZE_DEV_STR - 1 : end + 1);
 		}
+		ppanel_file->cw_sz2 = sz2 - ppanel_file->cw_sz1;
 	}
+	if (do_o) {
+		ow2 = ppanel_file->cw_ow1 + ppanel_file->cw_ow2;
+		uid2name(pfe->uid,&ulen);
+		gid2name(pfe->gid,&glen);
+		CW_SHRINK(ppanel_file->cw_ow1,FE_NAME_STR - 1 - ulen);
+		CW_GROW(ow2,FE_NAME_STR + glen);
+		ppanel_file->cw_ow2 = ow2 - ppanel_file->cw_ow1;
+	}
+}
 
-	if (sz2 < FE_SIZE_DEV_STR - 1 || ow2 < FE_OWNER_STR - 1)
-		for (i = 0; i < ppanel_file->all_cnt; i++) {
-			pfe = ppanel_file->all_files[i];
-			/* one of these assignments might be superfluous */
-			pfe->size_str[sz2]  = '\0';
-			pfe->owner_str[ow2] = '\0';
+/* readlink() for worker threads, return null if out of memory */
+static char *
+link_target(const char *name)
+{
+	size_t size;
+	ssize_t len;
+	char *link, *mem;
+
+	for (link = 0, size = 64; (mem = realloc(link,size)); size *= 2) {
+		link = mem;
+		if ((len = readlink(name,link,size)) < 0) {
+			strcpy(link,"??");
+			return link;
+		}
+		if (len < size) {
+			link[len] = '\0';
+			return link;
 		}
+	}
+	free(link);
+	return 0;
+}
+
+/*
+ * read the information about the file named 'name' into 'pst'
+ * (and the symbolic link target into 'plink')
+ *
+ * this is the time consuming part of describe_file() executed
+ * by worker threads, it may modify only the 'pfe->symlink', 'pst'
+ * and 'plink' data, see workers.c
+ */
+static int
+stat_file(const char *name, FILE_ENTRY *pfe, struct stat *pst, char **plink)
+{
+	if (lstat(name,pst) < 0) {
+		if (errno == ENOENT)
+			return STAT_GONE;		/* file deleted in the meantime */
+		pfe->symlink = 0;
+		return STAT_NOINFO;
+	}
+
+	if ( (pfe->symlink = S_ISLNK(pst->st_mode)) ) {
+		if ((*plink = link_target(name)) == 0)
+			return STAT_NOINFO;
+		/* need stat() instead of lstat() */
+		if (stat(name,pst) < 0)
+			return STAT_NOINFO;
+	}
 
-	ppanel_file->cw_mod = mod ? 0 : FE_MODE_STR - 1;
-	ppanel_file->cw_lns = lns ? 0 : 2;	/* strlen("->")  */
-	ppanel_file->cw_lnh = lnh ? 0 : 3;	/* strlen("LNK") */
-	ppanel_file->cw_ln1 = ln1 + 1;
-	ppanel_file->cw_sz1 = sz1 + 1;
-	ppanel_file->cw_ow1 = ow1 + 1;
-	ppanel_file->cw_age = age + 1;
-	ppanel_file->cw_sz2 = sz2 - sz1 - 1;
-	ppanel_file->cw_ow2 = ow2 - ow1 - 1;
+	return STAT_OK;
 }
 
-/* build the FILE_ENTRY '*pfe' describing the file named 'name' */
+/*
+ * stat_file() for all entries in a batch using io_uring
+ * return value: 0 = ok, -1 = io_uring not available
+ */
 static int
-describe_file(const char *name, FILE_ENTRY *pfe)
+stat_uring(STAT_BATCH *pb, const char **name)
 {
-	struct stat stdata;
+	int i, j, cnt, err[STAT_BATCH_SIZE], idx[STAT_BATCH_SIZE];
+	const char *lname[STAT_BATCH_SIZE];
+	struct stat st[STAT_BATCH_SIZE];
+	FILE_ENTRY *pfe;
 
-	if (use_pathname)
-		name = pathname_join(name);
+	if (uring_stat(pb->cnt,name,0,pb->st,err) < 0)
+		return -1;
 
-	if (lstat(name,&stdata) < 0) {
-		if (errno == ENOENT)
-			return -1;		/* file deleted in the meantime */
-		pfe->symlink = 0;
-		nofileinfo(pfe);
+	for (cnt = i = 0; i < pb->cnt; i++) {
+		pfe = pb->pfe[i];
+		if (err[i]) {
+			pfe->symlink = 0;
+			pb->status[i] = err[i] == ENOENT ? STAT_GONE : STAT_NOINFO;
+			continue;
+		}
+		pb->status[i] = STAT_OK;
+		if ( (pfe->symlink = S_ISLNK(pb->st[i].st_mode)) ) {
+			if ((pb->link[i] = link_target(name[i])) == 0) {
+				pb->status[i] = STAT_NOINFO;
+				continue;
+			}
+			lname[cnt] = name[i];
+			idx[cnt++] = i;
+		}
+	}
+	if (cnt == 0)
 		return 0;
+
+	/* symbolic links: need stat() instead of lstat() */
+	if (uring_stat(cnt,lname,1,st,err) < 0)
+		for (j = 0; j < cnt; j++)
+			err[j] = stat(lname[j],st + j) < 0 ? errno : 0;
+	for (j = 0; j < cnt; j++)
+		if (err[j])
+			pb->status[idx[j]] = STAT_NOINFO;
+		else
+			pb->st[idx[j]] = st[j];	/* struct copy */
+
+	return 0;
+}
+
+/* job function: stat_file() for all entries in a batch */
+static void
+stat_batch(void *arg)
+{
+	int i, len, dirlen;
+	char *pch;
+	const char *name[STAT_BATCH_SIZE];
+	STAT_BATCH *pb;
+	char *path;
+
+	pb = arg;
+	path = 0;
+	if (pb->dir) {
+		/* all pathnames in one buffer */
+		dirlen = strlen(pb->dir);
+		for (len = i = 0; i < pb->cnt; i++)
+			len += dirlen + strlen(pb->pfe[i]->file) + 1;
+		if ((path = malloc(len)) == 0) {
+			for (i = 0; i < pb->cnt; i++) {
+				pb->pfe[i]->symlink = 0;
+				pb->status[i] = STAT_NOINFO;
+			}
+			return;
+		}
+		for (pch = path, i = 0; i < pb->cnt; i++) {
+			name[i] = pch;
+			strcpy(pch,pb->dir);
+			strcpy(pch + dirlen,pb->pfe[i]->file);
+			pch += strlen(pch) + 1;
+		}
 	}
+	else
+		for (i = 0; i < pb->cnt; i++)
+			name[i] = pb->pfe[i]->file;
+
+	if (stat_uring(pb,name) < 0)
+		for (i = 0; i < pb->cnt; i++)
+			pb->status[i] = stat_file(name[i],pb->pfe[i],pb->st + i,pb->link + i);
+	free(path);
+}
+
+/*
+ * build the FILE_ENTRY from the i-th result of stat_batch(),
+ * an entry of a deleted file is marked with the 'gone' flag
+ */
+static void
+describe_entry(FILE_ENTRY *pfe, STAT_BATCH *pb, int i)
+{
+	FILE_EXTRA *px;
+
+	if ( (pfe->gone = pb->status[i] == STAT_GONE) )
+		return;
+	if (pfe->symlink) {
+		px = file_extra(pfe);
+		px->link = arena_strdup(&ppanel_file->arena,pb->link[i] ? pb->link[i] : "??");
+		px->linkw = arena_wcsdup(&ppanel_file->arena,convert2w(px->link));
+		free(pb->link[i]);
+		pb->link[i] = 0;
+	}
+	if (pb->status[i] == STAT_NOINFO)
+		nofileinfo(pfe);
+	else
+		fileinfo(pfe,pb->st + i);
+	cw_update(pfe);
+}
+
+/* build all FILE_ENTRIes described by stat_batch() */
+static void
+describe_merge(STAT_BATCH *pb)
+{
+	int i;
+
+	for (i = 0; i < pb->cnt; i++)
+		describe_entry(pb->pfe[i],pb,i);
+	pb->cnt = 0;
+}
 
-	if ( (pfe->symlink = S_ISLNK(stdata.st_mode)) ) {
-		if (us_readlink(&pfe->link,name) < 0) {
-			us_copy(&pfe->link,"??");
-			usw_copy(&pfe->linkw,L"??");
+/*
+ * describe_file() passes the entry to a worker thread; the FILE_ENTRY
+ * is complete after describe_wait(), the 'gone' flag is set if the
+ * file does not exist anymore
+ */
+static void
+describe_file(FILE_ENTRY *pfe)
+{
+	int i, j;
+	STAT_BATCH *pb;
+
+	if (batch == 0) {
+		batch = emalloc(STAT_BATCHES * sizeof(STAT_BATCH));
+		for (i = 0; i < STAT_BATCHES; i++) {
+			batch[i].cnt = 0;
+			for (j = 0; j < STAT_BATCH_SIZE; j++)
+				batch[i].link[j] = 0;
 		}
-		else
-			usw_convert2w(USTR(pfe->link),&pfe->linkw);
-		/* need stat() instead of lstat() */
-		if (stat(name,&stdata) < 0) {
-			nofileinfo(pfe);
-			return 0;
+	}
+
+	pb = batch + batch_cnt;
+	pb->pfe[pb->cnt++] = pfe;
+	if (pb->cnt < STAT_BATCH_SIZE)
+		return;
+
+	pb->dir = stat_dir;
+	work_submit(&stat_group,stat_batch,pb);
+	if (++batch_cnt < STAT_BATCHES)
+		return;
+
+	/* all batches are in use */
+	work_wait(&stat_group);
+	for (i = 0; i < batch_cnt; i++)
+		describe_merge(batch + i);
+	batch_cnt = 0;
+}
+
+static void
+describe_wait(void)
+{
+	int i;
+	STAT_BATCH *pb;
+
+	if (batch == 0)
+		return;
+
+	pb = batch + batch_cnt;
+	if (pb->cnt) {
+		pb->dir = stat_dir;
+		work_submit(&stat_group,stat_batch,pb);
+		batch_cnt++;
+	}
+	work_wait(&stat_group);
+	for (i = 0; i < batch_cnt; i++)
+		describe_merge(batch + i);
+	batch_cnt = 0;
+}
+
+/*
+ * The file compare lists both panels. While the primary panel is being
+ * listed, a worker thread reads the secondary panel's directory and
+ * then the file information is read by all workers into private storage,
+ * so the I/O for both panels runs concurrently. The jobs touch only the
+ * PREFETCH data. The
+ * results are merged into the secondary panel by directory_read() in
+ * the main thread.
+ */
+#define PF_ALLOC_UNIT	16	/* batches */
+typedef struct {
+	USTRING dir;			/* directory name with a trailing slash */
+	FLAG active;			/* job submitted, results not collected yet */
+	FLAG failed;			/* the directory cannot be listed */
+	FLAG nomem;				/* out of memory, the data is not usable */
+	int cnt;				/* number of entries */
+	int b_alloc;			/* allocated batches */
+	STAT_BATCH *batch;		/* entry 'i' is batch[i / STAT_BATCH_SIZE] */
+	ARENA arena;			/* temporary FILE_ENTRIes and names */
+} PREFETCH;
+static PREFETCH prefetch = { UNULL };
+static WORK_GROUP prefetch_group;
+
+/*
+ * job function: readdir() for the whole directory, then each batch
+ * is passed to stat_batch() in a separate job of the same group;
+ * if the memory runs out, the main thread will list the directory
+ * itself (emalloc() must not be called here)
+ */
+static void
+prefetch_job(void *arg)
+{
+	int i, j, b;
+	size_t size;
+	DIR *dd;
+	struct dirent *direntry;
+	FILE_ENTRY *pfe;
+	STAT_BATCH *pb;
+	PREFETCH *ppf;
+	char *name;
+
+	ppf = arg;
+	if ((dd = opendir(USTR(ppf->dir))) == 0) {
+		ppf->failed = 1;
+		return;
+	}
+	while ( (direntry = readdir(dd)) ) {
+		b = ppf->cnt / STAT_BATCH_SIZE;
+		if (ppf->cnt % STAT_BATCH_SIZE == 0) {
+			if (b == ppf->b_alloc) {
+				pb = realloc(ppf->batch,(ppf->b_alloc + PF_ALLOC_UNIT) * sizeof(STAT_BATCH));
+				if (pb == 0)
+					break;
+				ppf->batch = pb;
+				for (i = 0; i < PF_ALLOC_UNIT; i++)
+					for (j = 0; j < STAT_BATCH_SIZE; j++)
+						ppf->batch[b + i].link[j] = 0;
+				ppf->b_alloc += PF_ALLOC_UNIT;
+			}
+			ppf->batch[b].dir = USTR(ppf->dir);
+			ppf->batch[b].cnt = 0;
 		}
+		pb = ppf->batch + b;
+		size = strlen(direntry->d_name) + 1;
+		if ((pfe = arena_tryalloc(&ppf->arena,sizeof(FILE_ENTRY))) == 0
+		  || (name = arena_tryalloc(&ppf->arena,size)) == 0)
+			break;
+		pfe->file = memcpy(name,direntry->d_name,size);
+		pb->pfe[pb->cnt++] = pfe;
+		ppf->cnt++;
 	}
+	/* the loop ends early only when out of memory */
+	ppf->nomem = direntry != 0;
+	closedir(dd);
+	if (ppf->nomem)
+		return;
 
-	fileinfo(pfe,&stdata);
-	return 0;
+	/* 'batch' is not reallocated anymore */
+	for (b = 0; b * STAT_BATCH_SIZE < ppf->cnt; b++)
+		work_submit(&prefetch_group,stat_batch,ppf->batch + b);
+}
+
+static void
+prefetch_start(const char *dir)
+{
+	us_cat(&prefetch.dir,dir,"/",(char *)0);
+	prefetch.active = 1;
+	prefetch.failed = prefetch.nomem = 0;
+	prefetch.cnt = 0;
+	work_submit(&prefetch_group,prefetch_job,&prefetch);
+}
+
+static void
+prefetch_release(void)
+{
+	int i, j;
+
+	for (i = 0; i < prefetch.b_alloc; i++)
+		for (j = 0; j < STAT_BATCH_SIZE; j++)
+			free(prefetch.batch[i].link[j]);
+	efree(prefetch.batch);
+	prefetch.batch = 0;
+	prefetch.b_alloc = 0;
+	arena_reset(&prefetch.arena);
+	arena_trim(&prefetch.arena,0);
+}
+
+/* return the prefetched data for the current panel or null if there are none */
+static PREFETCH *
+prefetch_get(void)
+{
+	if (!prefetch.active)
+		return 0;
+	work_wait(&prefetch_group);
+	prefetch.active = 0;
+	if (prefetch.nomem) {
+		prefetch_release();
+		return 0;
+	}
+	return &prefetch;
 }
 
 #define DOT_NONE		0	/* not a .file */
@@ -844,34 +1465,241 @@ dotfile(const char *name)
 	return DOT_HIDDEN;
 }
 
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+/*
+ * file type according to the directory entry, FT_NA if the file
+ * information must be read in order to find out the type
+ */
+static int
+dirent2type(int d_type)
+{
+	switch (d_type) {
+	case DT_REG:
+		return FT_PLAIN_FILE;
+	case DT_DIR:
+		return FT_DIRECTORY;
+	case DT_FIFO:
+		return FT_FIFO;
+	case DT_SOCK:
+		return FT_SOCKET;
+	}
+	/* symbolic links, devices, unknown */
+	return FT_NA;
+}
+#endif
+
+/* final steps after a describe_wait() */
+static void
+describe_finish(FLAG future_before)
+{
+	int i;
+	FILE_ENTRY *pfe;
+
+	if (mm_change) {
+		for (i = 0; i < ppanel_file->all_cnt; i++) {
+			pfe = ppanel_file->all_files[i];
+			if (IS_FT_DEV(pfe->file_type) && !pfe->pending)
+				cw_update(pfe);
+		}
+		mm_change = 0;
+	}
+	/* the file information has changed */
+	fmt_gen++;
+
+	/*
+	 * report a problem only once per directory listing; the time
+	 * is formatted when displayed, i.e. the problem is reported
+	 * with a delay
+	 */
+	if (td_fmt_fail && !td_fmt_reported) {
+		td_fmt_reported = 1;
+		msgout(MSG_NOTICE,"Time/date format \"%ls\" produces output of variable length, "
+		  "check the configuration",td_fmt_fail);
+		msgout(MSG_w,"Problem with date/time output format, details in log");
+	}
+	if (future && !future_before && !NOPT(NOTIF_FUTURE))
+		msgout(MSG_i | MSG_NOTIFY,"FILE LIST: timestamp in the future encountered");
+}
+
+/*
+ * a hash set of file entries: the names kept in step #1 of directory_read()
+ * or the current names during directory_changes(); open addressing with
+ * linear probing, the size is a power of two, there is room for 'room'
+ * more entries
+ */
+static FILE_ENTRY **kept = 0;
+static unsigned int kept_size = 0;
+
+static void
+kept_init(FILE_ENTRY **list, int cnt, int room)
+{
+	int i;
+	unsigned int size, h;
+
+	for (size = 64; size < 2 * (cnt + room); size *= 2)
+		;
+	if (size != kept_size) {
+		efree(kept);
+		kept = emalloc((kept_size = size) * sizeof(FILE_ENTRY *));
+	}
+	memset(kept,0,size * sizeof(FILE_ENTRY *));
+	for (i = 0; i < cnt; i++) {
+		for (h = strhash(list[i]->file) & (size - 1); kept[h]; h = (h + 1) & (size - 1))
+			;
+		kept[h] = list[i];
+	}
+}
+
+/* return the slot with the 'name' or an empty slot where it belongs */
+static unsigned int
+kept_slot(const char *name)
+{
+	unsigned int h;
+
+	for (h = strhash(name) & (kept_size - 1); kept[h]; h = (h + 1) & (kept_size - 1))
+		if (strcmp(kept[h]->file,name) == 0)
+			break;
+	return h;
+}
+
+static int
+kept_find(const char *name)
+{
+	return kept[kept_slot(name)] != 0;
+}
+
+/* resize the 'all_files' array, the 'files' pointer must follow it */
+static void
+all_files_alloc(int alloc)
+{
+	FLAG unfiltered;
+
+	unfiltered = ppanel_file->files == ppanel_file->all_files;
+	ppanel_file->all_alloc = alloc;
+	ppanel_file->all_files = erealloc(ppanel_file->all_files,alloc * sizeof(FILE_ENTRY *));
+	if (unfiltered)
+		ppanel_file->files = ppanel_file->all_files;
+}
+
+/*
+ * a slow listing shows the entries read so far, the elapsed
+ * time is checked after every PROGRESS_STEP entries
+ */
+#define PROGRESS_STEP	256
+#define PROGRESS_MS		300		/* screen update interval in milliseconds */
+
+static long
+elapsed_ms(const struct timeval *since)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv,0);
+	return 1000 * (long)(tv.tv_sec - since->tv_sec) + (long)(tv.tv_usec - since->tv_usec) / 1000;
+}
+
+/*
+ * display the first 'cnt' entries while directory_read() is still
+ * running, deleted files are removed from the list first
+ *
+ * return value: the number of remaining entries
+ */
+static int
+directory_progress(int cnt, int *ppending)
+{
+	int i, j;
+	FILE_ENTRY *pfe;
+	static wchar_t msg[48];
+
+	describe_wait();
+	for (i = j = 0; i < cnt; i++) {
+		pfe = ppanel_file->all_files[i];
+		if (!pfe->gone)
+			ppanel_file->all_files[j++] = pfe;
+		else if (pfe->select)
+			ppanel_file->selected--;
+	}
+	/* entries added or removed since the last call */
+	if (j != cnt || cnt != ppanel_file->all_cnt)
+		ppanel_file->list_gen++;
+	ppanel_file->all_cnt = j;
+	ppanel_file->pending = *ppending;
+	ppanel_file->timestamp = now;
+	sort_files();
+
+	if (panel == ppanel_file->pd) {
+		/* filepos_set() will find the right position when finished */
+		panel->top = panel->min;
+		panel->curs = 0;
+		pan_adjust(panel);
+		/* this reads the information about the displayed pending entries */
+		win_panel();
+		*ppending = ppanel_file->pending;
+	}
+	swprintf(msg,ARRAY_SIZE(msg),L"%d entries read ...",j);
+	win_sethelp(HELPMSG_INFO,msg);
+	win_waitmsg();
+
+	return j;
+}
+
 static void
 directory_read(void)
 {
-	int i, cnt1, cnt2;
+	int i, cnt1, cnt2, pending, nread, pf_next;
 	DIR *dd;
 	FILE_ENTRY *pfe;
-	FLAG hide;
+	STAT_BATCH *pb;
+	PREFETCH *ppf;
+	FLAG hide, postpone, progress, shown;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+	int type;
+#endif
 	struct stat st;
+	struct timeval tv;
 	struct dirent *direntry;
 	const char *name;
+	ARENA arena_old;
+	static USTRING dirbuff = UNULL;
 
+	/* the secondary panel might have been read in advance, see prefetch_job() */
+	ppf = use_pathname ? prefetch_get() : 0;
+	dd = 0;
+	direntry = 0;
 	name = USTR(ppanel_file->dir);
-	if (stat(name,&st) < 0 || (dd = opendir(name)) == 0) {
+	if (stat(name,&st) < 0 || (ppf ? ppf->failed : (dd = opendir(name)) == 0)) {
+		if (ppf)
+			prefetch_release();
 		ppanel_file->all_cnt = ppanel_file->pd->cnt = 0;
 		ppanel_file->selected = ppanel_file->selected_out = 0;
 		msgout(MSG_w,"FILE LIST: cannot list the contents of the directory");
+		watch_stop(ppanel_file);
 		return;
 	}
-	dirdev = st.st_dev;
+	/* changes made during the listing will be applied later by directory_update() */
+	watch_start(ppanel_file);
+	ppanel_file->dirdev = st.st_dev;
+	/* pathname_join() is not usable in worker threads */
+	stat_dir = use_pathname ? us_copy(&dirbuff,pathname_join("")) : 0;
 
 	win_waitmsg();
-	mm_change = future = 0;
-	td_fmt_fail = 0;
+	mm_change = future = td_fmt_reported = 0;
+	cw_reset();
+	ppanel_file->list_gen++;
+	ppanel_file->partial = 0;
 	ppanel_file->hidden = 0;
 	hide = ppanel_file->hide == HIDE_ALWAYS
 		   || (ppanel_file->hide == HIDE_HOME
 			   && strcmp(USTR(ppanel_file->dir),user_data.homedir) == 0);
 
+	/*
+	 * the old entries remain valid until the end of step #1,
+	 * then their storage will be reused by the next listing
+	 */
+	arena_old = ppanel_file->arena_old;		/* struct copy */
+	ppanel_file->arena_old = ppanel_file->arena;
+	ppanel_file->arena = arena_old;
+	arena_reset(&ppanel_file->arena);
+
 	/*
 	 * step #1: process selected files already listed in the panel
 	 * in order not to lose their selection mark
@@ -883,11 +1711,16 @@ directory_read(void)
 		pfe = ppanel_file->all_files[i];
 		if (!pfe->select)
 			continue;
-		name = SDSTR(pfe->file);
-		if ((hide && dotfile(name) == DOT_HIDDEN) || describe_file(name, pfe) < 0)
+		if (hide && dotfile(pfe->file) == DOT_HIDDEN)
 			/* this entry is no more valid */
 			ppanel_file->selected--;
 		else {
+			pfe = entry_new(pfe->file);
+			pfe->dotdir = ppanel_file->all_files[i]->dotdir;
+			pfe->select = 1;
+			pfe->gone = 0;
+			pfe->pending = 0;
+			describe_file(pfe);
 			/* OK, move it to the end of list we have so far */
 			/* by swapping pointers: [cnt1] <--> [i] */
 			ppanel_file->all_files[i] = ppanel_file->all_files[cnt1];
@@ -896,70 +1729,357 @@ directory_read(void)
 		}
 	}
 
-	/* step #2: add data about new files */
+	if (cnt1)
+		kept_init(ppanel_file->all_files,cnt1,0);
+
+	/*
+	 * step #2: add data about new files
+	 *
+	 * reading of the file information might be postponed until the
+	 * file is displayed, but only if the directory entry tells the
+	 * file type and the sort order does not need the information
+	 */
+	postpone = !full_info && !ppf && !SORT_NEEDS_INFO(ppanel_file->order);
+	pending = 0;
 	cnt2 = cnt1;
-	while ( (direntry = readdir(dd)) ) {
-		name = direntry->d_name;
+	/*
+	 * the file compare (full_info) needs complete listings of both
+	 * panels, the progress display is not used there
+	 */
+	progress = disp_data.curses && !full_info;
+	shown = 0;
+	nread = 0;
+	pf_next = 0;
+	gettimeofday(&tv,0);
+	for (;/* until break */;) {
+		if (ppf) {
+			if (pf_next == ppf->cnt)
+				break;
+			name = ppf->batch[pf_next / STAT_BATCH_SIZE].pfe[pf_next % STAT_BATCH_SIZE]->file;
+			pf_next++;
+		}
+		else {
+			if ((direntry = readdir(dd)) == 0)
+				break;
+			name = direntry->d_name;
+		}
+
+		if (progress) {
+			if (shown && ctrlc_flag)
+				break;
+			if (++nread % PROGRESS_STEP == 0 && elapsed_ms(&tv) >= PROGRESS_MS) {
+				if (!shown) {
+					/* allow to stop the listing */
+					ctrlc_flag = 0;
+					signal_ctrlc_on();
+					shown = 1;
+				}
+				cnt2 = directory_progress(cnt2,&pending);
+				gettimeofday(&tv,0);
+			}
+		}
 		if (hide && dotfile(name) == DOT_HIDDEN) {
 			ppanel_file->hidden = 1;
 			continue;
 		}
 
 		/* didn't we process this file already in step #1 ? */
-		if (cnt1) {
-			for (i = 0; i < cnt1; i++)
-				if (strcmp(SDSTR(ppanel_file->all_files[i]->file),name) == 0)
-					break;
-			if (i < cnt1)
-				continue;
-		}
+		if (cnt1 && kept_find(name))
+			continue;
 
-		/* allocate new bunch of FILE_ENTRies if needed */
-		if (cnt2 == ppanel_file->all_alloc) {
-			ppanel_file->all_alloc += FE_ALLOC_UNIT;
-			ppanel_file->all_files = erealloc(ppanel_file->all_files,
-			  ppanel_file->all_alloc * sizeof(FILE_ENTRY *));
-			pfe = emalloc(FE_ALLOC_UNIT * sizeof(FILE_ENTRY));
-			for (i = 0; i < FE_ALLOC_UNIT; i++) {
-				SD_INIT(pfe[i].file);
-				SD_INIT(pfe[i].filew);
-				US_INIT(pfe[i].link);
-				US_INIT(pfe[i].linkw);
-				ppanel_file->all_files[cnt2 + i] = pfe + i;
-			}
-		}
+		if (cnt2 == ppanel_file->all_alloc)
+			all_files_alloc(ppanel_file->all_alloc + FE_ALLOC_UNIT);
 
-		pfe = ppanel_file->all_files[cnt2];
-		sd_copy(&pfe->file,name);
-		sdw_copy(&pfe->filew,convert2w(name));
+		pfe = ppanel_file->all_files[cnt2++] = entry_new(name);
 		pfe->dotdir = dotfile(name);
 		if (pfe->dotdir == DOT_HIDDEN)
 			pfe->dotdir = DOT_NONE;
-		if (describe_file(name, pfe) < 0)
-			continue;
 		pfe->select = 0;
-		cnt2++;
+		pfe->gone = 0;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+		if (postpone && (type = dirent2type(direntry->d_type)) != FT_NA) {
+			nofileinfo(pfe);
+			pfe->file_type = type;
+			pfe->symlink = 0;
+			pfe->pending = 1;
+			pending++;
+			continue;
+		}
+#endif
+		pfe->pending = 0;
+		if (ppf) {
+			pb = ppf->batch + (pf_next - 1) / STAT_BATCH_SIZE;
+			i = (pf_next - 1) % STAT_BATCH_SIZE;
+			pfe->symlink = pb->pfe[i]->symlink;
+			describe_entry(pfe,pb,i);
+		}
+		else
+			describe_file(pfe);
 	}
-	ppanel_file->all_cnt = cnt2;
 
-	closedir(dd);
+	if (ppf)
+		prefetch_release();
+	else
+		closedir(dd);
+	if (shown) {
+		signal_ctrlc_off();
+		win_sethelp(HELPMSG_INFO,0);
+		if (ctrlc_flag) {
+			msgout(MSG_i,"FILE LIST: listing stopped, the panel is incomplete");
+			/* the changes of an incomplete list cannot be tracked */
+			watch_stop(ppanel_file);
+			ppanel_file->expired = 1;
+		}
+	}
 
-	if (mm_change)
-		for (i = 0; i < cnt2; i++) {
-			pfe = ppanel_file->all_files[i];
-			if (IS_FT_DEV(pfe->file_type))
-				stat2dev(pfe->size_str,major(pfe->devnum),minor(pfe->devnum));
+	/* step #3: wait for the file information, remove deleted files */
+	describe_wait();
+	for (i = cnt1 = 0; i < cnt2; i++) {
+		pfe = ppanel_file->all_files[i];
+		if (pfe->gone) {
+			if (pfe->select)
+				ppanel_file->selected--;
+			continue;
 		}
+		/* swapping pointers: [cnt1] <--> [i] */
+		ppanel_file->all_files[i] = ppanel_file->all_files[cnt1];
+		ppanel_file->all_files[cnt1++] = pfe;
+	}
+	ppanel_file->all_cnt = cnt1;
+	ppanel_file->pending = pending;
 
-	if (td_fmt_fail) {
-		msgout(MSG_NOTICE,"Time/date format \"%ls\" produces output of variable length, "
-		  "check the configuration",td_fmt_fail);
-		msgout(MSG_w,"Problem with date/time output format, details in log");
+	/*
+	 * the old entries are not needed anymore; the spare arena is trimmed
+	 * to the size of the current one, i.e. after moving from a large
+	 * directory to a small one the memory is returned to the system
+	 */
+	arena_reset(&ppanel_file->arena_old);
+	arena_trim(&ppanel_file->arena_old,ppanel_file->arena.size);
+	arena_trim(&ppanel_file->arena,0);
+	if (ppanel_file->all_alloc > 2 * cnt1 + FE_ALLOC_UNIT)
+		all_files_alloc(cnt1 + FE_ALLOC_UNIT);
+	ppanel_file->list_gen++;
+
+	describe_finish(0);
+}
+
+/*
+ * changes reported by the directory watch, see directory_update();
+ * the 'gone' flag marks entries in 'all_files' and 'upd_files' to be removed
+ */
+#define UPD_MAX		256		/* more changes than this -> re-read the directory */
+static FILE_ENTRY **upd_files = 0;	/* new or changed entries */
+static int upd_cnt, upd_alloc = 0;
+static int upd_changes;
+static FLAG upd_hide;
+
+/*
+ * watch_read() callback; all entries are looked up in the 'kept' set,
+ * an entry replaced by a newer one is marked 'gone'
+ */
+static int
+update_file(int change, const char *name)
+{
+	int dot;
+	unsigned int h;
+	FLAG sel, found;
+	FILE_ENTRY *pfe;
+
+	if ((dot = dotfile(name)) == DOT_HIDDEN && upd_hide) {
+		ppanel_file->hidden = 1;
+		return 0;
 	}
-	if (future && !NOPT(NOTIF_FUTURE))
-		msgout(MSG_i | MSG_NOTIFY,"FILE LIST: timestamp in the future encountered");
+	if (++upd_changes > UPD_MAX)
+		return -1;
+	if (upd_changes == 1)
+		/* +1 for the directory itself, see directory_changes() */
+		kept_init(ppanel_file->all_files,ppanel_file->all_cnt,UPD_MAX + 1);
+
+	/* the new information replaces the old one */
+	sel = found = 0;
+	h = kept_slot(name);
+	if ((pfe = kept[h]) && !pfe->gone) {
+		sel = pfe->select;
+		pfe->gone = found = 1;
+	}
+	if (change == WATCH_GONE || (dot == DOT_DIR && !found))
+		return 0;
+
+	if (upd_cnt == upd_alloc) {
+		upd_alloc += 32;
+		upd_files = erealloc(upd_files,upd_alloc * sizeof(FILE_ENTRY *));
+	}
+	pfe = kept[h] = upd_files[upd_cnt++] = entry_new(name);
+	pfe->dotdir = dot == DOT_HIDDEN ? DOT_NONE : dot;
+	pfe->select = sel;
+	pfe->gone = 0;
+	pfe->pending = 0;
+	return 0;
+}
+
+/*
+ * collect the changes reported by the directory watch
+ *
+ * return value: 1 = changes found, 0 = no changes,
+ * -1 = the changes are not known, the directory must be re-read
+ * (the 'gone' marks do not matter then, directory_read() creates
+ * new entries)
+ */
+static int
+directory_changes(void)
+{
+	upd_cnt = upd_changes = 0;
+	upd_hide = ppanel_file->hide == HIDE_ALWAYS
+			   || (ppanel_file->hide == HIDE_HOME
+				   && strcmp(USTR(ppanel_file->dir),user_data.homedir) == 0);
+	if (watch_read(ppanel_file,update_file) < 0)
+		return -1;
+	if (upd_changes == 0)
+		return 0;
+	/* the modification time of the directory itself has changed */
+	update_file(WATCH_CHANGED,".");
+	return 1;
+}
+
+/*
+ * apply the changes found by directory_changes() to the file list
+ * of the current panel, the list remains sorted
+ */
+static void
+directory_update(void)
+{
+	int i, cnt;
+	FLAG future_before;
+	FILE_ENTRY *pfe;
+
+	mm_change = 0;
+	future_before = future;
+	stat_dir = 0;	/* the panel's directory is the cwd */
+	/* drop the entries replaced by update_file(), describe_file() resets 'gone' */
+	for (i = cnt = 0; i < upd_cnt; i++)
+		if (!upd_files[i]->gone)
+			upd_files[cnt++] = upd_files[i];
+	upd_cnt = cnt;
+	for (i = 0; i < upd_cnt; i++)
+		describe_file(upd_files[i]);
+	describe_wait();
+	ppanel_file->list_gen++;
+
+	for (i = cnt = 0; i < ppanel_file->all_cnt; i++) {
+		pfe = ppanel_file->all_files[i];
+		if (!pfe->gone)
+			ppanel_file->all_files[cnt++] = pfe;
+		else if (pfe->pending)
+			ppanel_file->pending--;
+	}
+	ppanel_file->all_cnt = cnt;
+	for (i = cnt = 0; i < upd_cnt; i++)
+		if (!upd_files[i]->gone)
+			upd_files[cnt++] = upd_files[i];
+	if (ppanel_file->all_alloc < ppanel_file->all_cnt + cnt)
+		all_files_alloc(ppanel_file->all_cnt + cnt + FE_ALLOC_UNIT);
+	sort_insert(upd_files,cnt);
+
+	/* file_panel_data() counts the selected entries in a filtered panel only */
+	for (i = cnt = 0; i < ppanel_file->all_cnt; i++)
+		if (ppanel_file->all_files[i]->select)
+			cnt++;
+	ppanel_file->selected = cnt;
+	ppanel_file->selected_out = 0;
+
+	describe_finish(future_before);
+}
 
-	set_cw();
+/* file types distinguished by the grouping, see sort_group() in sort.c */
+static int
+type_group(int type)
+{
+	if (IS_FT_PLAIN(type))
+		return 0;
+	if (IS_FT_DIR(type))
+		return 1;
+	if (IS_FT_DEV(type))
+		return type;
+	return 2;
+}
+
+/*
+ * read the postponed file information, see directory_read()
+ *
+ * The saved sort results (see sort.c) remain valid unless a file type
+ * group has changed: the orders by name depend only on the name and the
+ * group, and the orders by size or time do not leave any pending entries.
+ */
+static void
+pending_info(FILE_ENTRY **list, int cnt)
+{
+	int i;
+	FLAG future_before, changed;
+	FILE_ENTRY *pfe;
+	static CODE *type = 0;		/* file types before reading the information */
+	static int type_alloc = 0;
+
+	/* the file panel shows the file information as of the listing time */
+	now = ppanel_file->timestamp;
+	now_day = localtime(&now)->tm_mday;
+	future_before = future;
+	stat_dir = 0;	/* the panel's directory is the cwd */
+
+	if (type_alloc < cnt) {
+		efree(type);
+		type = emalloc((type_alloc = cnt) * sizeof(CODE));
+	}
+	for (i = 0; i < cnt; i++) {
+		pfe = list[i];
+		type[i] = pfe->pending ? type_group(pfe->file_type) : -1;
+		if (pfe->pending) {
+			pfe->pending = 0;
+			ppanel_file->pending--;
+			describe_file(pfe);
+		}
+	}
+	describe_wait();
+
+	/* do not remove deleted files from the panel now, just mark them */
+	for (changed = i = 0; i < cnt; i++) {
+		pfe = list[i];
+		if (pfe->gone) {
+			pfe->gone = 0;
+			nofileinfo(pfe);
+		}
+		/* device numbers are used for grouping too */
+		if (type[i] >= 0 && (type_group(pfe->file_type) != type[i] || IS_FT_DEV(pfe->file_type)))
+			changed = 1;
+	}
+	if (changed)
+		ppanel_file->list_gen++;
+
+	describe_finish(future_before);
+}
+
+/*
+ * make sure the file information is available for the entries
+ * files[from] to files[to - 1] in the current file panel
+ */
+void
+filepanel_info(int from, int to)
+{
+	if (from < 0)
+		from = 0;
+	if (to > ppanel_file->pd->cnt)
+		to = ppanel_file->pd->cnt;
+	if (ppanel_file->partial && to > ppanel_file->partial)
+		sort_finish();
+	if (ppanel_file->pending && from < to)
+		pending_info(ppanel_file->files + from,to - from);
+}
+
+/* make sure the file information is available for all entries in the current file panel */
+void
+filepanel_info_all(void)
+{
+	if (ppanel_file->pending)
+		pending_info(ppanel_file->all_files,ppanel_file->all_cnt);
 }
 
 /* invalidate file panel contents after a directory change */
@@ -973,15 +2093,78 @@ filepanel_reset(void)
 	ppanel_file->hide = panel_sort.hide;
 }
 
-void
-file_panel_data(void)
+/*
+ * recent results of the substring or fuzzy filter, used when only
+ * the filter changes, see file_panel_filter(); the filter string
+ * at each level contains the string of the previous level (as
+ * a subsequence for the fuzzy filter), i.e. each result is a subset
+ * of the previous one
+ */
+#define FILT_DEPTH	16
+typedef struct {
+	USTRINGW filter;		/* dequoted filter string */
+	FILE_ENTRY **files;		/* entries matching the filter */
+	int cnt, alloc;
+} FILT_LEVEL;
+static FILT_LEVEL filt_level[FILT_DEPTH];
+static int filt_depth = 0;
+static PANEL_FILE *filt_panel;		/* the panel the results belong to */
+static FLAG filt_type;				/* filter type used */
+static FLAG filt_ic, filt_showdir;	/* FOPT_IC, FOPT_SHOWDIR options used */
+
+/* can be the results of the 'prev' filter narrowed down for the 'filter' ? */
+static int
+filt_narrows(const wchar_t *filter, const wchar_t *prev, int type)
+{
+	if (type == 0)
+		return wcsstr(filter,prev) != 0;
+
+	/* fuzzy: 'prev' must be a subsequence of 'filter' */
+	for (; *prev != L'\0'; prev++, filter++)
+		if ((filter = wcschr(filter,*prev)) == 0)
+			return 0;
+	return 1;
+}
+
+static void
+filt_push(const wchar_t *filter, FILE_ENTRY **files, int cnt)
+{
+	FILT_LEVEL save, *pfl;
+
+	if (filt_depth > 0 && wcscmp(USTR(filt_level[filt_depth - 1].filter),filter) == 0)
+		return;		/* already there */
+	if (filt_depth == FILT_DEPTH) {
+		/* drop the oldest level, but keep its memory */
+		save = filt_level[0];	/* struct copy */
+		memmove(filt_level,filt_level + 1,(FILT_DEPTH - 1) * sizeof(FILT_LEVEL));
+		filt_level[--filt_depth] = save;
+	}
+	pfl = filt_level + filt_depth++;
+	usw_copy(&pfl->filter,filter);
+	if (pfl->alloc < cnt) {
+		efree(pfl->files);
+		pfl->files = emalloc((pfl->alloc = cnt) * sizeof(FILE_ENTRY *));
+	}
+	if ((pfl->cnt = cnt))
+		memcpy(pfl->files,files,cnt * sizeof(FILE_ENTRY *));
+}
+
+/*
+ * prepare the 'files' list from 'all_files' according to the filter;
+ * with 'narrow' set only the filter has changed since the last call
+ */
+static void
+filepanel_data(FLAG narrow)
 {
 	const wchar_t *filter;
 	static USTRINGW dequote = UNULL;
-	FILE_ENTRY *pfe, *curs;
-	int i, j, selected_in, selected_out;
-	FLAG type;	/* type 0 = substring, type 1 = pattern */
+	FILE_ENTRY *pfe, *curs, **cand;
+	int i, j, cand_cnt, selected_in, selected_out, selected_all, score;
+	FLAG type;	/* see PANEL_FILE.filtype */
+	FLAG substr, match;
 
+	if (!narrow)
+		filt_depth = 0;
 	if (ppanel_file->all_cnt == 0) {
 		/* panel is empty */
 		ppanel_file->pd->cnt  = 0;
@@ -1017,30 +2200,71 @@ file_panel_data(void)
 	}
 
 	filter = ppanel_file->pd->filter->line;
-	type = ispattern(filter);
+	type = FOPT(FOPT_REGEX) ? 2 : ispattern(filter) ? 1 : FOPT(FOPT_FUZZY) ? 3 : 0;
 	if (ppanel_file->filtype != type) {
 		ppanel_file->filtype = type;
 		win_filter();
 	}
-	if (type)
+	substr = type == 0 || type == 3;
+	if (type == 2)
+		match_regex_set(filter);
+	else if (type == 1)
 		match_pattern_set(filter);
 	else {
 		if (isquoted(filter)) {
 			usw_dequote(&dequote,filter,wcslen(filter));
 			filter = USTR(dequote);
 		}
-		match_substr_set(filter);
+		if (type == 3)
+			match_fuzzy_set(filter);
+		else
+			match_substr_set(filter);
+	}
+
+	/*
+	 * if the new substring contains the previous one, only
+	 * the entries matching the previous one are tested
+	 */
+	cand = ppanel_file->all_files;
+	cand_cnt = ppanel_file->all_cnt;
+	if (narrow && substr && filt_panel == ppanel_file && filt_type == type
+	  && filt_ic == FOPT(FOPT_IC) && filt_showdir == FOPT(FOPT_SHOWDIR)) {
+		while (filt_depth > 0 && !filt_narrows(filter,USTR(filt_level[filt_depth - 1].filter),type))
+			filt_depth--;
+		if (filt_depth > 0) {
+			cand = filt_level[filt_depth - 1].files;
+			cand_cnt = filt_level[filt_depth - 1].cnt;
+		}
+	}
+	else {
+		filt_depth = 0;		/* the old results cannot be used */
+		filt_panel = ppanel_file;
+		filt_type = type;
+		filt_ic = FOPT(FOPT_IC);
+		filt_showdir = FOPT(FOPT_SHOWDIR);
 	}
+	selected_all = ppanel_file->selected + ppanel_file->selected_out;
 
 	curs = VALID_CURSOR(ppanel_file->pd) ? ppanel_file->files[ppanel_file->pd->curs] : 0;
-	for (i = j = selected_in = selected_out = 0; i < ppanel_file->all_cnt; i++) {
-		pfe = ppanel_file->all_files[i];
+	for (i = j = selected_in = selected_out = 0; i < cand_cnt; i++) {
+		pfe = cand[i];
 		if (pfe == curs)
 			ppanel_file->pd->curs = j;
-		if ((FOPT(FOPT_SHOWDIR) && IS_FT_DIR(pfe->file_type))
-		  || (type ? match_pattern(SDSTR(pfe->file)) : match_substr(SDSTR(pfe->filew)))
-		  || (pfe->symlink &&
-		  (type ? match_pattern(USTR(pfe->link)) : match_substr(USTR(pfe->linkw))))) {
+		if (type == 3) {
+			/* the directories shown by the FOPT_SHOWDIR go last */
+			score = file_fuzzy(pfe);
+			match = score > 0 || (FOPT(FOPT_SHOWDIR) && IS_FT_DIR(pfe->file_type));
+		}
+		else
+			match = (FOPT(FOPT_SHOWDIR) && IS_FT_DIR(pfe->file_type))
+			  || (type == 2 ? match_regex_lc(FOPT(FOPT_IC) ? file_namelc(pfe) : tmp_namew(pfe))
+			    : type ? match_pattern(pfe->file) : FOPT(FOPT_IC)
+			    ? match_substr_lc(file_namelc(pfe)) : match_substr(tmp_namew(pfe)))
+			  || (pfe->symlink && (type == 2 ? match_regex(pfe->extra->linkw)
+			    : type ? match_pattern(pfe->extra->link) : match_substr(pfe->extra->linkw)));
+		if (match) {
+			if (type == 3)
+				match_fuzzy_keep(score);
 			ppanel_file->filt_files[j++] = pfe;
 			if (pfe->select)
 				selected_in++;
@@ -1048,42 +2272,105 @@ file_panel_data(void)
 		else if (pfe->select)
 			selected_out++;		/* selected, but filtered out */
 	}
+	if (cand != ppanel_file->all_files)
+		/* the entries not tested do not match */
+		selected_out = selected_all - selected_in;
+	if (substr)
+		filt_push(filter,ppanel_file->filt_files,j);
+	if (type == 3) {
+		/* best matches first */
+		match_fuzzy_sort(ppanel_file->filt_files,j,sizeof(FILE_ENTRY *));
+		for (i = 0; i < j; i++)
+			if (ppanel_file->filt_files[i] == curs) {
+				ppanel_file->pd->curs = i;
+				break;
+			}
+	}
 	ppanel_file->pd->cnt = j;
 	ppanel_file->selected = selected_in;
 	ppanel_file->selected_out = selected_out;
 	ppanel_file->files = ppanel_file->filt_files;
 }
 
+void
+file_panel_data(void)
+{
+	filepanel_data(0);
+}
+
+/* like file_panel_data(), but the list of files has not changed, only the filter */
+void
+file_panel_filter(void)
+{
+	filepanel_data(1);
+}
+
 static void
 filepanel_read(void)
 {
 	filepos_save();
+	/* directory_read() sets 'expired' if the listing was stopped */
+	ppanel_file->expired = 0;
 	directory_read();
 	sort_files();
 	/* sort_files() calls file_panel_data() */
 	filepos_set();
+	ppanel_file->timestamp = ppanel_file->read_time = now;
+}
+
+/* like filepanel_read(), but only the changes are processed */
+static int
+filepanel_update(void)
+{
+	switch (directory_changes()) {
+	case 0:
+		return -1;
+	case -1:
+		filepanel_read();
+		return 0;
+	}
+	filepos_save();
+	directory_update();
+	file_panel_data();
+	filepos_set();
 	ppanel_file->timestamp = now;
-	ppanel_file->expired = 0;
+	return 0;
 }
 
 int
 list_directory_cond(int expiration_time)
 {
 	now = time(0);
+	now_day = localtime(&now)->tm_mday;
 
 	/* password data change invalidates data in both panels */
 	if (userdata_refresh()) {
 		ppanel_file->other->expired = 1;
 		ucache_cnt = gcache_cnt = 0;
 	}
+	else if (expiration_time && !ppanel_file->expired && ppanel_file->watch_wd >= 0) {
+		/* not all changes are reported, see watch.c */
+		if (now < ppanel_file->read_time + expiration_time)
+			return filepanel_update();
+	}
 	else if (expiration_time && now < ppanel_file->timestamp + expiration_time)
 		return -1;
 
-	now_day = localtime(&now)->tm_mday;
 	filepanel_read();
 	return 0;
 }
 
+/*
+ * bring the current panel up to date after an operation which might
+ * have modified the directory; a watched panel is re-read only
+ * when older than PANEL_EXPTIME
+ */
+void
+list_directory_update(void)
+{
+	list_directory_cond(ppanel_file->watch_wd >= 0 ? PANEL_EXPTIME : 0);
+}
+
 void
 list_directory(void)
 {
@@ -1093,7 +2380,11 @@ list_directory(void)
 void
 list_both_directories(void)
 {
+	/* the caller (file compare) needs the file information */
+	full_info = 1;
+	prefetch_start(USTR(ppanel_file->other->dir));
 	list_directory();
+	sort_finish();
 
 	/*
 	 * warning: during the re-reading of the secondary panel it becomes the primary panel,
@@ -1103,6 +2394,8 @@ list_both_directories(void)
 	pathname_set_directory(USTR(ppanel_file->dir));
 	use_pathname = 1;	/* must prepend directory name */
 	filepanel_read();
+	sort_finish();
 	use_pathname = 0;
 	ppanel_file = ppanel_file->other;
+	full_info = 0;
 }
@@ -4,7 +4,14 @@ extern void td_fmt_reconfig(void);
 extern void list_initialize(void);
 extern void list_directory(void);
 extern int  list_directory_cond(int);
+extern void list_directory_update(void);
 extern void list_both_directories(void);
 extern void filepanel_reset(void);
 extern void file_panel_data(void);
+extern void file_panel_filter(void);
+extern void filepanel_info(int, int);
+extern void filepanel_info_all(void);
+extern const wchar_t *file_namew(FILE_ENTRY *);
+extern void file_rename(FILE_ENTRY *, const char *);
+extern const FILE_FIELDS *file_fields(const FILE_ENTRY *);
 extern int  stat2type(mode_t, uid_t);
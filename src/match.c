@@ -15,48 +15,323 @@
 #include "clexheaders.h"
 
 #include <fnmatch.h>		/* fnmatch */
+#include <limits.h>			/* INT_MIN, CHAR_BIT */
+#include <stdlib.h>			/* qsort() */
+#include <string.h>			/* strlen(), memcpy() */
+#include <wchar.h>			/* wmemcmp(), wcscmp() */
 #include <wctype.h>			/* towlower() */
+#ifdef __AVX2__
+# include <immintrin.h>		/* _mm256_cmpeq_epi32() */
+#endif
+#ifdef __SSE2__
+# include <emmintrin.h>		/* _mm_cmpeq_epi32() */
+#endif
 
 #include "match.h"
 
 #include "mbwstring.h"		/* us_convert2mb() */
+#include "util.h"			/* erealloc() */
 
 /* match pattern */
 
-static USTRING pattern = UNULL;
+/*
+ * The pattern is compiled by match_pattern_set() into a list of tokens
+ * matched by a simple backtracking matcher, only the last '*' needs
+ * to be revisited. The result is the same as with fnmatch(); patterns
+ * with features not supported here (ranges, character classes, etc.)
+ * and multibyte characters in patterns or names are passed to fnmatch().
+ */
+enum PT_TYPE {
+	PT_CHAR,	/* literal character */
+	PT_ANY,		/* ? */
+	PT_STAR,	/* * */
+	PT_SET,		/* [...] */
+	PT_NSET		/* [!...] */
+};
+typedef struct {
+	enum PT_TYPE type;
+	wchar_t ch;				/* PT_CHAR */
+	size_t set, setlen;		/* PT_SET, PT_NSET: characters in 'setchars' */
+} PTOKEN;
+
+static USTRING pattern = UNULL;		/* for fnmatch() */
+static PTOKEN *ptok = 0;
+static int pt_cnt, pt_alloc = 0;
+static int pt_prefix;				/* leading PT_CHAR tokens */
+static int pt_suffix;				/* trailing PT_CHAR tokens after the last PT_STAR */
+static int pt_min;					/* minimum name length */
+static FLAG pt_star;				/* there is a PT_STAR */
+static FLAG pt_fnmatch;				/* use fnmatch() instead */
+static USTRINGW setchars = UNULL;
+
+static PTOKEN *
+pt_add(enum PT_TYPE type, wchar_t ch)
+{
+	if (pt_cnt == pt_alloc)
+		ptok = erealloc(ptok,(pt_alloc += 16) * sizeof(PTOKEN));
+	ptok[pt_cnt].type = type;
+	ptok[pt_cnt].ch = ch;
+	return ptok + pt_cnt++;
+}
+
+/* return -1 if the pattern must be handled by fnmatch() */
+static int
+pattern_compile(const wchar_t *p)
+{
+	wchar_t ch;
+	size_t len, start;
+	FLAG first, neg;
+	PTOKEN *pt;
+
+	pt_cnt = 0;
+	len = 0;
+	while (*p) {
+		switch (*p) {
+		case L'*':
+			if (pt_cnt == 0 || ptok[pt_cnt - 1].type != PT_STAR)
+				pt_add(PT_STAR,0);
+			p++;
+			break;
+		case L'?':
+			pt_add(PT_ANY,0);
+			p++;
+			break;
+		case L'\\':
+			if (p[1] == L'\0')
+				return -1;
+			pt_add(PT_CHAR,p[1]);
+			p += 2;
+			break;
+		case L'[':
+			neg = 0;
+			if (*++p == L'!' || *p == L'^') {
+				if (*p == L'^' && getenv("POSIXLY_CORRECT"))
+					return -1;
+				neg = 1;
+				p++;
+			}
+			start = len;
+			for (first = 1; (ch = *p) != L']' || first; p++, first = 0) {
+				if (ch == L'\0')
+					return -1;		/* not terminated */
+				if (ch == L'[' && (p[1] == L':' || p[1] == L'=' || p[1] == L'.'))
+					return -1;		/* class */
+				if (ch == L'\\') {
+					if ((ch = *++p) == L'\0')
+						return -1;
+				}
+				else if (ch == L'-' && !first && p[1] != L']')
+					return -1;		/* range */
+				usw_resize(&setchars,len + 1);
+				USTR(setchars)[len++] = ch;
+			}
+			p++;
+			pt = pt_add(neg ? PT_NSET : PT_SET,0);
+			pt->set = start;
+			pt->setlen = len - start;
+			break;
+		default:
+			pt_add(PT_CHAR,*p++);
+		}
+	}
+	return 0;
+}
+
+static int
+pt_match(const PTOKEN *pt, wchar_t ch)
+{
+	switch (pt->type) {
+	case PT_CHAR:
+		return ch == pt->ch;
+	case PT_SET:
+		return wmemchr(USTR(setchars) + pt->set,ch,pt->setlen) != 0;
+	case PT_NSET:
+		return wmemchr(USTR(setchars) + pt->set,ch,pt->setlen) == 0;
+	default:
+		/* PT_ANY */
+		return 1;
+	}
+}
+
+static int
+pattern_run(const wchar_t *word, int len)
+{
+	int i, t, star_i, star_t;
+
+	/* quick checks first */
+	if (len < pt_min || (!pt_star && len != pt_min))
+		return 0;
+	for (i = 0; i < pt_prefix; i++)
+		if (word[i] != ptok[i].ch)
+			return 0;
+	for (i = 1; i <= pt_suffix; i++)
+		if (word[len - i] != ptok[pt_cnt - i].ch)
+			return 0;
+
+	for (i = t = pt_prefix, star_t = -1, star_i = 0; i < len; ) {
+		if (t < pt_cnt && ptok[t].type == PT_STAR) {
+			star_t = ++t;
+			star_i = i;
+		}
+		else if (t < pt_cnt && pt_match(ptok + t,word[i])) {
+			t++;
+			i++;
+		}
+		else if (star_t >= 0) {
+			/* let the last '*' match one more character */
+			t = star_t;
+			i = ++star_i;
+		}
+		else
+			return 0;
+	}
+	while (t < pt_cnt && ptok[t].type == PT_STAR)
+		t++;
+	return t == pt_cnt;
+}
 
 void
 match_pattern_set(const wchar_t *expr)
 {
+	int i;
+	const unsigned char *pw;
+	static USTRINGW wpattern = UNULL;
+
 	us_convert2mb(expr,&pattern);
+
+	/* multibyte characters are left to fnmatch() */
+	pt_fnmatch = 1;
+	usw_setsize(&wpattern,strlen(USTR(pattern)) + 1);
+	for (pw = (const unsigned char *)USTR(pattern), i = 0; (USTR(wpattern)[i] = pw[i]); i++)
+		if (pw[i] >= 0x80 && MB_CUR_MAX > 1)
+			return;
+	if (pattern_compile(USTR(wpattern)) < 0)
+		return;
+	pt_fnmatch = 0;
+
+	for (pt_prefix = 0; pt_prefix < pt_cnt && ptok[pt_prefix].type == PT_CHAR; pt_prefix++)
+		;
+	for (pt_star = 0, pt_min = i = 0; i < pt_cnt; i++)
+		if (ptok[i].type == PT_STAR)
+			pt_star = 1;
+		else
+			pt_min++;
+	pt_suffix = 0;
+	if (pt_star)
+		while (ptok[pt_cnt - pt_suffix - 1].type == PT_CHAR)
+			pt_suffix++;
 }
 
 int
 match_pattern(const char *word)
 {
-	return fnmatch(USTR(pattern),word,FOPT(FOPT_ALL) ? 0 : FNM_PERIOD) == 0;
+	int i;
+	const unsigned char *pw;
+	static USTRINGW wword = UNULL;
+
+	if (pt_fnmatch)
+		return fnmatch(USTR(pattern),word,FOPT(FOPT_ALL) ? 0 : FNM_PERIOD) == 0;
+
+	/* FNM_PERIOD: a leading dot must be matched explicitly */
+	if (*word == '.' && !FOPT(FOPT_ALL) && (pt_prefix == 0 || ptok[0].ch != L'.'))
+		return 0;
+
+	usw_setsize(&wword,strlen(word) + 1);
+	for (pw = (const unsigned char *)word, i = 0; pw[i]; i++) {
+		if (pw[i] >= 0x80 && MB_CUR_MAX > 1)
+			return fnmatch(USTR(pattern),word,FOPT(FOPT_ALL) ? 0 : FNM_PERIOD) == 0;
+		USTR(wword)[i] = pw[i];
+	}
+	return pattern_run(USTR(wword),i);
 }
 
 /* match substring */
 
 static USTRINGW substr_orig = UNULL;	/* original */
 static USTRINGW substr_lc   = UNULL;	/* lowercase copy */
+static size_t substr_len;				/* length of both */
 static FLAG lc;							/* substr_lc is valid */
 
-static void
-inplace_tolower(wchar_t *p)
+/* convert a string to lowercase in place */
+wchar_t *
+match_lowercase(wchar_t *str)
 {
-	wchar_t ch;
+	wchar_t ch, *p;
 
-	for (; (ch = *p) != L'\0'; p++)
+	for (p = str; (ch = *p) != L'\0'; p++)
 		if (iswupper(ch))
 			*p = towlower(ch);
+	return str;
+}
+
+/*
+ * find 'sub' of length 'sublen' in 'str'
+ *
+ * The vectorized loops compare the first and the last character of 'sub'
+ * at 8 (AVX2) or 4 (SSE2) positions at once, the whole 'sub' is compared
+ * only where both of them match. The rest is done by the scalar loop.
+ */
+static int
+substr_find(const wchar_t *str, const wchar_t *sub, size_t sublen)
+{
+	size_t i, k, len;
+	unsigned int mask;
+#ifdef __AVX2__
+	__m256i first8, last8, eq8;
+#endif
+#ifdef __SSE2__
+	__m128i first4, last4, eq4;
+#endif
+
+	if (sublen == 0)
+		return 1;
+	len = wcslen(str);
+	if (len < sublen)
+		return 0;
+	i = 0;
+
+#ifdef __AVX2__
+	if (sizeof(wchar_t) == 4) {
+		first8 = _mm256_set1_epi32(sub[0]);
+		last8 = _mm256_set1_epi32(sub[sublen - 1]);
+		for (; i + 8 + sublen - 1 <= len; i += 8) {
+			eq8 = _mm256_and_si256(
+			  _mm256_cmpeq_epi32(first8,_mm256_loadu_si256((const __m256i *)(str + i))),
+			  _mm256_cmpeq_epi32(last8,_mm256_loadu_si256((const __m256i *)(str + i + sublen - 1))));
+			if ( (mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq8))) )
+				for (k = 0; k < 8; k++)
+					if ((mask & 1 << k) && wmemcmp(str + i + k,sub,sublen) == 0)
+						return 1;
+		}
+	}
+#endif
+#ifdef __SSE2__
+	if (sizeof(wchar_t) == 4) {
+		first4 = _mm_set1_epi32(sub[0]);
+		last4 = _mm_set1_epi32(sub[sublen - 1]);
+		for (; i + 4 + sublen - 1 <= len; i += 4) {
+			eq4 = _mm_and_si128(
+			  _mm_cmpeq_epi32(first4,_mm_loadu_si128((const __m128i *)(str + i))),
+			  _mm_cmpeq_epi32(last4,_mm_loadu_si128((const __m128i *)(str + i + sublen - 1))));
+			if ( (mask = _mm_movemask_ps(_mm_castsi128_ps(eq4))) )
+				for (k = 0; k < 4; k++)
+					if ((mask & 1 << k) && wmemcmp(str + i + k,sub,sublen) == 0)
+						return 1;
+		}
+	}
+#endif
+
+	for (; i + sublen <= len; i++)
+		if (str[i] == sub[0] && wmemcmp(str + i,sub,sublen) == 0)
+			return 1;
+	return 0;
 }
 
 void
 match_substr_set(const wchar_t *expr)
 {
 	usw_copy(&substr_orig,expr);
+	substr_len = wcslen(expr);
 	lc = 0;
 }
 
@@ -66,21 +341,630 @@ match_substr(const wchar_t *str)
 	if (FOPT(FOPT_IC))
 		return match_substr_ic(str);
 
-	return wcsstr(str,USTR(substr_orig)) != 0;
+	return substr_find(str,USTR(substr_orig),substr_len);
 }
 
 int
 match_substr_ic(const wchar_t *str)
 {
 	static USTRINGW buff = UNULL;
-	wchar_t *str_lc;
 
+	return match_substr_lc(match_lowercase(usw_copy(&buff,str)));
+}
+
+/* like match_substr_ic(), but 'str_lc' is already converted to lowercase */
+int
+match_substr_lc(const wchar_t *str_lc)
+{
 	if (!lc) {
-		inplace_tolower(usw_copy(&substr_lc,USTR(substr_orig)));
+		match_lowercase(usw_copy(&substr_lc,USTR(substr_orig)));
 		lc = 1;
 	}
 
-	str_lc = usw_copy(&buff,str);
-	inplace_tolower(str_lc);
-	return wcsstr(str_lc,USTR(substr_lc)) != 0;
+	return substr_find(str_lc,USTR(substr_lc),substr_len);
+}
+
+/* match regular expression */
+
+/*
+ * A subset of the POSIX extended regular expressions is supported:
+ * . [] [^] ^ $ * + ? | () and backslash quoting. The expression is parsed
+ * into a tree, the tree is compiled into a program for a non-backtracking
+ * NFA simulation (Thompson's construction). All possible states are
+ * tracked in parallel, the matching time is linear in the length
+ * of the string for any expression.
+ */
+enum RX_NODE_TYPE {
+	RN_EMPTY, RN_CHAR, RN_ANY, RN_SET, RN_NSET, RN_BOL, RN_EOL,
+	RN_CAT, RN_ALT, RN_STAR, RN_PLUS, RN_QUEST
+};
+typedef struct {
+	enum RX_NODE_TYPE type;
+	wchar_t ch;				/* RN_CHAR */
+	int left, right;		/* subexpressions; RN_SET, RN_NSET: ranges in 'rx_sets' */
+} RX_NODE;
+
+enum RX_OP {
+	RX_CHAR, RX_ANY, RX_SET, RX_NSET, RX_BOL, RX_EOL, RX_SPLIT, RX_JMP, RX_MATCH
+};
+typedef struct {
+	enum RX_OP op;
+	wchar_t ch;				/* RX_CHAR */
+	int x, y;				/* RX_SPLIT, RX_JMP: targets; RX_SET, RX_NSET: ranges */
+} RX_INST;
+
+static USTRINGW rx_expr = UNULL;	/* the compiled expression */
+static FLAG rx_ic;					/* compiled for case insensitive matching */
+static FLAG rx_valid = 0;			/* the expression is valid */
+static const wchar_t *rx_p;			/* parser position */
+static int rx_depth;				/* parentheses nesting level */
+static RX_NODE *rx_node = 0;
+static int rx_ncnt, rx_nalloc = 0;
+static USTRINGW rx_sets = UNULL;	/* character ranges: pairs low,high */
+static int rx_setlen;
+static RX_INST *rx = 0;				/* the program */
+static int rx_cnt, rx_alloc = 0;
+static int *rx_clist = 0, *rx_nlist = 0, *rx_stack = 0;
+static unsigned int *rx_mark = 0, rx_gen;
+
+static int rx_parse_alt(void);
+
+static int
+rx_node_new(enum RX_NODE_TYPE type, int left, int right)
+{
+	if (rx_ncnt == rx_nalloc)
+		rx_node = erealloc(rx_node,(rx_nalloc += 32) * sizeof(RX_NODE));
+	rx_node[rx_ncnt].type = type;
+	rx_node[rx_ncnt].left = left;
+	rx_node[rx_ncnt].right = right;
+	return rx_ncnt++;
+}
+
+static void
+rx_set_add(wchar_t low, wchar_t high)
+{
+	usw_resize(&rx_sets,rx_setlen + 2);
+	USTR(rx_sets)[rx_setlen++] = low;
+	USTR(rx_sets)[rx_setlen++] = high;
+}
+
+/* [...] without the opening bracket, return -1 on error */
+static int
+rx_parse_set(void)
+{
+	wchar_t ch, high;
+	int start;
+	FLAG first, neg;
+
+	neg = *rx_p == L'^';
+	if (neg)
+		rx_p++;
+	start = rx_setlen;
+	for (first = 1; (ch = *rx_p) != L']' || first; first = 0) {
+		if (ch == L'\0')
+			return -1;
+		/* backslash is an ordinary character here */
+		rx_p++;
+		high = ch;
+		if (*rx_p == L'-' && rx_p[1] != L']' && rx_p[1] != L'\0') {
+			high = *++rx_p;
+			rx_p++;
+			if (high < ch)
+				return -1;
+		}
+		rx_set_add(ch,high);
+	}
+	rx_p++;
+	return rx_node_new(neg ? RN_NSET : RN_SET,start,rx_setlen - start);
+}
+
+static int
+rx_parse_atom(void)
+{
+	int n;
+	wchar_t ch;
+
+	switch (ch = *rx_p++) {
+	case L'(':
+		rx_depth++;
+		if ((n = rx_parse_alt()) < 0 || *rx_p++ != L')')
+			return -1;
+		rx_depth--;
+		return n;
+	case L'.':
+		return rx_node_new(RN_ANY,0,0);
+	case L'^':
+		return rx_node_new(RN_BOL,0,0);
+	case L'$':
+		return rx_node_new(RN_EOL,0,0);
+	case L'[':
+		return rx_parse_set();
+	case L'*':
+	case L'+':
+	case L'?':
+		return -1;		/* nothing to repeat */
+	case L'\\':
+		if ((ch = *rx_p++) == L'\0')
+			return -1;
+		break;
+	}
+	n = rx_node_new(RN_CHAR,0,0);
+	rx_node[n].ch = ch;
+	return n;
+}
+
+static int
+rx_parse_cat(void)
+{
+	int n, atom;
+	enum RX_NODE_TYPE type;
+
+	n = -1;
+	/* unmatched ')' is an ordinary character */
+	while (*rx_p != L'\0' && *rx_p != L'|' && (*rx_p != L')' || rx_depth == 0)) {
+		if ((atom = rx_parse_atom()) < 0)
+			return -1;
+		for (;;) {
+			if (*rx_p == L'*')
+				type = RN_STAR;
+			else if (*rx_p == L'+')
+				type = RN_PLUS;
+			else if (*rx_p == L'?')
+				type = RN_QUEST;
+			else
+				break;
+			rx_p++;
+			atom = rx_node_new(type,atom,0);
+		}
+		n = n < 0 ? atom : rx_node_new(RN_CAT,n,atom);
+	}
+	return n < 0 ? rx_node_new(RN_EMPTY,0,0) : n;
+}
+
+static int
+rx_parse_alt(void)
+{
+	int n, right;
+
+	if ((n = rx_parse_cat()) < 0)
+		return -1;
+	while (*rx_p == L'|') {
+		rx_p++;
+		if ((right = rx_parse_cat()) < 0)
+			return -1;
+		n = rx_node_new(RN_ALT,n,right);
+	}
+	return n;
+}
+
+static int
+rx_emit(enum RX_OP op, int x, int y)
+{
+	if (rx_cnt == rx_alloc)
+		rx = erealloc(rx,(rx_alloc += 64) * sizeof(RX_INST));
+	rx[rx_cnt].op = op;
+	rx[rx_cnt].x = x;
+	rx[rx_cnt].y = y;
+	return rx_cnt++;
+}
+
+static void
+rx_compile(int n)
+{
+	int i, split, jmp;
+	RX_NODE *pn;
+
+	pn = rx_node + n;
+	switch (pn->type) {
+	case RN_EMPTY:
+		break;
+	case RN_CHAR:
+		i = rx_emit(RX_CHAR,0,0);
+		rx[i].ch = pn->ch;
+		break;
+	case RN_ANY:
+		rx_emit(RX_ANY,0,0);
+		break;
+	case RN_SET:
+	case RN_NSET:
+		rx_emit(pn->type == RN_SET ? RX_SET : RX_NSET,pn->left,pn->right);
+		break;
+	case RN_BOL:
+		rx_emit(RX_BOL,0,0);
+		break;
+	case RN_EOL:
+		rx_emit(RX_EOL,0,0);
+		break;
+	case RN_CAT:
+		rx_compile(pn->left);
+		rx_compile(pn->right);
+		break;
+	case RN_ALT:
+		split = rx_emit(RX_SPLIT,0,0);
+		rx[split].x = rx_cnt;
+		rx_compile(pn->left);
+		jmp = rx_emit(RX_JMP,0,0);
+		rx[split].y = rx_cnt;
+		rx_compile(pn->right);
+		rx[jmp].x = rx_cnt;
+		break;
+	case RN_STAR:
+		split = rx_emit(RX_SPLIT,0,0);
+		rx[split].x = rx_cnt;
+		rx_compile(pn->left);
+		rx_emit(RX_JMP,split,0);
+		rx[split].y = rx_cnt;
+		break;
+	case RN_PLUS:
+		jmp = rx_cnt;
+		rx_compile(pn->left);
+		rx_emit(RX_SPLIT,jmp,rx_cnt + 1);
+		break;
+	case RN_QUEST:
+		split = rx_emit(RX_SPLIT,0,0);
+		rx[split].x = rx_cnt;
+		rx_compile(pn->left);
+		rx[split].y = rx_cnt;
+		break;
+	}
+}
+
+/*
+ * compile the regular expression unless it is the same as the last one,
+ * return -1 if it is invalid
+ */
+int
+match_regex_set(const wchar_t *expr)
+{
+	int n;
+	static USTRINGW lcexpr = UNULL;
+
+	if (rx_expr.USstr != 0 && rx_ic == FOPT(FOPT_IC) && wcscmp(USTR(rx_expr),expr) == 0)
+		return rx_valid ? 0 : -1;
+
+	usw_copy(&rx_expr,expr);
+	rx_ic = FOPT(FOPT_IC);
+	rx_valid = 0;
+	rx_ncnt = rx_setlen = rx_cnt = rx_depth = 0;
+	rx_p = rx_ic ? match_lowercase(usw_copy(&lcexpr,expr)) : USTR(rx_expr);
+	if ((n = rx_parse_alt()) < 0 || *rx_p != L'\0')
+		return -1;
+	rx_compile(n);
+	rx_emit(RX_MATCH,0,0);
+
+	efree(rx_clist);
+	efree(rx_nlist);
+	efree(rx_stack);
+	efree(rx_mark);
+	rx_clist = emalloc(rx_cnt * sizeof(int));
+	rx_nlist = emalloc(rx_cnt * sizeof(int));
+	rx_stack = emalloc((2 * rx_cnt + 1) * sizeof(int));
+	rx_mark = emalloc(rx_cnt * sizeof(unsigned int));
+	for (n = 0; n < rx_cnt; n++)
+		rx_mark[n] = 0;
+	rx_gen = 0;
+	rx_valid = 1;
+	return 0;
+}
+
+static int
+rx_inset(int set, int setlen, wchar_t ch)
+{
+	const wchar_t *range;
+
+	for (range = USTR(rx_sets) + set; setlen > 0; setlen -= 2, range += 2)
+		if (ch >= range[0] && ch <= range[1])
+			return 1;
+	return 0;
+}
+
+/*
+ * add the thread at 'pc' and all threads reachable from it without
+ * consuming a character to the 'list', return 1 if a match was found
+ */
+static int
+rx_addthread(int *list, int *pcnt, int pc, const wchar_t *str, int pos)
+{
+	int sp;
+
+	sp = 0;
+	rx_stack[sp++] = pc;
+	while (sp > 0) {
+		pc = rx_stack[--sp];
+		if (rx_mark[pc] == rx_gen)
+			continue;
+		rx_mark[pc] = rx_gen;
+		switch (rx[pc].op) {
+		case RX_MATCH:
+			return 1;
+		case RX_JMP:
+			rx_stack[sp++] = rx[pc].x;
+			break;
+		case RX_SPLIT:
+			rx_stack[sp++] = rx[pc].y;
+			rx_stack[sp++] = rx[pc].x;
+			break;
+		case RX_BOL:
+			if (pos == 0)
+				rx_stack[sp++] = pc + 1;
+			break;
+		case RX_EOL:
+			if (str[pos] == L'\0')
+				rx_stack[sp++] = pc + 1;
+			break;
+		default:
+			list[(*pcnt)++] = pc;
+		}
+	}
+	return 0;
+}
+
+static void
+rx_nextgen(void)
+{
+	int i;
+
+	if (++rx_gen == 0) {
+		for (i = 0; i < rx_cnt; i++)
+			rx_mark[i] = 0;
+		rx_gen = 1;
+	}
+}
+
+/* search for the regular expression anywhere in the 'str' */
+static int
+rx_search(const wchar_t *str)
+{
+	int i, pos, pc, ccnt, ncnt, *tmp, *clist, *nlist;
+	wchar_t ch;
+	FLAG ok;
+
+	clist = rx_clist;
+	nlist = rx_nlist;
+	ccnt = 0;
+	rx_nextgen();
+	for (pos = 0; ; pos++) {
+		/* a new thread is started at each position */
+		if (rx_addthread(clist,&ccnt,0,str,pos))
+			return 1;
+		if ((ch = str[pos]) == L'\0')
+			return 0;
+		rx_nextgen();
+		for (i = ncnt = 0; i < ccnt; i++) {
+			pc = clist[i];
+			switch (rx[pc].op) {
+			case RX_CHAR:
+				ok = ch == rx[pc].ch;
+				break;
+			case RX_SET:
+				ok = rx_inset(rx[pc].x,rx[pc].y,ch);
+				break;
+			case RX_NSET:
+				ok = !rx_inset(rx[pc].x,rx[pc].y,ch);
+				break;
+			default:
+				/* RX_ANY */
+				ok = 1;
+			}
+			if (ok && rx_addthread(nlist,&ncnt,pc + 1,str,pos + 1))
+				return 1;
+		}
+		tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		ccnt = ncnt;
+	}
+}
+
+int
+match_regex(const wchar_t *str)
+{
+	static USTRINGW buff = UNULL;
+
+	if (!rx_valid)
+		return 0;
+	if (rx_ic)
+		str = match_lowercase(usw_copy(&buff,str));
+	return rx_search(str);
+}
+
+/* like match_regex(), but 'str_lc' is already converted to lowercase if necessary */
+int
+match_regex_lc(const wchar_t *str_lc)
+{
+	return rx_valid && rx_search(str_lc);
+}
+
+/* fuzzy matching */
+
+/*
+ * The characters of the expression must appear in the string in
+ * the same order, but not necessarily adjacent. The case is ignored.
+ * Matching strings are scored, higher score means better match:
+ * consecutive characters and characters at word boundaries score
+ * more, gaps between the matched characters score less.
+ *
+ * A bit mask of characters present (see match_charmask()) rejects most
+ * of the non-matching strings at the cost of a single AND operation if
+ * the caller keeps the mask of each string.
+ */
+#define FZ_MATCH		16	/* matched character */
+#define FZ_BOUNDARY		8	/* ... at the beginning of a word */
+#define FZ_CONSEC		6	/* ... following the previous matched character */
+#define FZ_CASE			1	/* ... with the same case */
+#define FZ_GAP			1	/* each unmatched character between two matched ones */
+
+#define CHARMASK_BITS	(CHAR_BIT * sizeof(unsigned long))
+
+static USTRINGW fz_expr = UNULL;	/* original */
+static USTRINGW fz_lc = UNULL;		/* lowercase copy */
+static int fz_len;
+static unsigned long fz_mask;
+static int *fz_row = 0, fz_row_alloc = 0;	/* the scoring table: 2 rows */
+static int *fz_keep = 0, fz_keep_cnt, fz_keep_alloc = 0;	/* kept scores */
+
+/* a bit for each character in the lowercase 'str' */
+unsigned long
+match_charmask(const wchar_t *str)
+{
+	wchar_t ch;
+	unsigned long mask;
+
+	for (mask = 0; (ch = *str++) != L'\0'; )
+		mask |= 1UL << (unsigned long)ch % CHARMASK_BITS;
+	return mask;
+}
+
+void
+match_fuzzy_set(const wchar_t *expr)
+{
+	usw_copy(&fz_expr,expr);
+	fz_mask = match_charmask(match_lowercase(usw_copy(&fz_lc,expr)));
+	fz_len = wcslen(expr);
+	fz_keep_cnt = 0;
+}
+
+/* is there a word boundary in 'str' at position 'i' ? */
+static int
+fz_boundary(const wchar_t *str, int i)
+{
+	wchar_t prev;
+
+	if (i == 0)
+		return 1;
+	prev = str[i - 1];
+	if (prev == L'/' || prev == L'.' || prev == L'_' || prev == L'-' || prev == L' ')
+		return 1;
+	/* camelCase and letters followed by digits */
+	return (iswlower(prev) && iswupper(str[i])) || (!iswdigit(prev) && iswdigit(str[i]));
+}
+
+/*
+ * like match_fuzzy(), but the lowercase 'str_lc' and its 'mask'
+ * are computed by the caller
+ */
+int
+match_fuzzy_lc(const wchar_t *str, const wchar_t *str_lc, unsigned long mask)
+{
+	int i, j, k, len, best, run, sc, *prev, *cur, *tmp;
+	wchar_t qch;
+
+	if (fz_len == 0)
+		return 1;
+	if ((mask & fz_mask) != fz_mask)
+		return 0;
+
+	/* quick subsequence test */
+	for (i = j = 0; str_lc[j] != L'\0'; j++)
+		if (str_lc[j] == USTR(fz_lc)[i] && ++i == fz_len)
+			break;
+	if (i < fz_len)
+		return 0;
+	k = j;		/* the last character must be at 'k' or later */
+	len = wcslen(str_lc);
+
+	/*
+	 * prev[j], cur[j]: best score of the expression up to the
+	 * i-th character matched with the j-th character of the string
+	 */
+	if (fz_row_alloc < 2 * len) {
+		efree(fz_row);
+		fz_row = emalloc((fz_row_alloc = 2 * len) * sizeof(int));
+	}
+	prev = fz_row;
+	cur = fz_row + len;
+	for (i = 0; i < fz_len; i++) {
+		qch = USTR(fz_lc)[i];
+		run = INT_MIN;
+		for (j = 0; j < len; j++) {
+			/* run = best prev[0 .. j-2] including the gap penalty */
+			if (run != INT_MIN)
+				run -= FZ_GAP;
+			if (j >= 2 && prev[j - 2] != INT_MIN && prev[j - 2] - FZ_GAP > run)
+				run = prev[j - 2] - FZ_GAP;
+			cur[j] = INT_MIN;
+			if (str_lc[j] != qch)
+				continue;
+			if (i == 0)
+				best = 0;
+			else {
+				best = run;
+				if (j > 0 && prev[j - 1] != INT_MIN && prev[j - 1] + FZ_CONSEC > best)
+					best = prev[j - 1] + FZ_CONSEC;
+				if (best == INT_MIN)
+					continue;
+			}
+			sc = FZ_MATCH;
+			if (fz_boundary(str,j))
+				sc += FZ_BOUNDARY;
+			if (str[j] == USTR(fz_expr)[i])
+				sc += FZ_CASE;
+			cur[j] = best + sc;
+		}
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+
+	for (best = INT_MIN, j = k; j < len; j++)
+		if (prev[j] > best)
+			best = prev[j];
+	return best < 1 ? 1 : best;
+}
+
+/* return the score of 'str' or 0 if it does not match */
+int
+match_fuzzy(const wchar_t *str)
+{
+	const wchar_t *lc;
+	static USTRINGW buff = UNULL;
+
+	lc = match_lowercase(usw_copy(&buff,str));
+	return match_fuzzy_lc(str,lc,match_charmask(lc));
+}
+
+/* keep the score of the next entry stored for match_fuzzy_sort() */
+void
+match_fuzzy_keep(int score)
+{
+	if (fz_keep_cnt == fz_keep_alloc)
+		fz_keep = erealloc(fz_keep,(fz_keep_alloc += 1024) * sizeof(int));
+	fz_keep[fz_keep_cnt++] = score;
+}
+
+static int
+qcmp_score(const void *e1, const void *e2)
+{
+	const int *i1, *i2;
+
+	i1 = e1;
+	i2 = e2;
+	if (fz_keep[*i1] != fz_keep[*i2])
+		return fz_keep[*i1] > fz_keep[*i2] ? -1 : 1;
+	return *i1 - *i2;
+}
+
+/*
+ * sort the array of 'cnt' entries of given 'size' by the kept scores,
+ * best matches first, the order of entries with equal score is kept
+ */
+void
+match_fuzzy_sort(void *base, int cnt, size_t size)
+{
+	int i, *order;
+	char *copy;
+
+	if (cnt != fz_keep_cnt || cnt < 2)
+		return;
+	order = emalloc(cnt * sizeof(int));
+	for (i = 0; i < cnt; i++)
+		order[i] = i;
+	qsort(order,cnt,sizeof(int),qcmp_score);
+	copy = emalloc(cnt * size);
+	memcpy(copy,base,cnt * size);
+	for (i = 0; i < cnt; i++)
+		memcpy((char *)base + i * size,copy + order[i] * size,size);
+	efree(copy);
+	efree(order);
+	fz_keep_cnt = 0;
 }
@@ -3,3 +3,14 @@ extern int match_pattern(const char *);
 extern void match_substr_set(const wchar_t *);
 extern int match_substr(const wchar_t *);
 extern int match_substr_ic(const wchar_t *);
+extern int match_substr_lc(const wchar_t *);
+extern wchar_t *match_lowercase(wchar_t *);
+extern int match_regex_set(const wchar_t *);
+extern int match_regex(const wchar_t *);
+extern int match_regex_lc(const wchar_t *);
+extern unsigned long match_charmask(const wchar_t *);
+extern void match_fuzzy_set(const wchar_t *);
+extern int match_fuzzy_lc(const wchar_t *, const wchar_t *, unsigned long);
+extern int match_fuzzy(const wchar_t *);
+extern void match_fuzzy_keep(int);
+extern void match_fuzzy_sort(void *, int, size_t);
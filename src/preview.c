@@ -20,6 +20,7 @@
 #include "preview.h"
 
 #include "filerw.h"
+#include "list.h"
 #include "log.h"
 #include "mbwstring.h"
 
@@ -65,7 +66,7 @@ preview_prepare(void)
 		return -1;
 	}
 
-	tfd = fr_open_preview(SDSTR(pfe->file), PREVIEW_BYTES);
+	tfd = fr_open_preview(pfe->file, PREVIEW_BYTES);
 	if (tfd < 0) {
 		msgout(MSG_i,"PREVIEW: unable to read the file, details in log");
 		return -1;
@@ -84,7 +85,7 @@ preview_prepare(void)
 	fr_close(tfd);
 
 	panel_preview.pd->top = panel_preview.pd->curs = 0;
-	panel_preview.title = SDSTR(pfe->filew);
+	panel_preview.title = file_namew(pfe);
 
 	panel = panel_preview.pd;
 	textline = 0;
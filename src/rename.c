@@ -26,7 +26,7 @@
 
 #include "edit.h"		/* edit_nu_putstr() */
 #include "inout.h"		/* win_panel() */
-#include "list.h"		/* list_directory() */
+#include "list.h"		/* file_namew() */
 #include "log.h"		/* msgout() */
 #include "mbwstring.h"	/* convert2mb() */
 
@@ -49,7 +49,7 @@ rename_prepare(void)
 
 	edit_setprompt(&line_tmp,L"Rename the current file to: ");
 	textline = &line_tmp;
-	edit_nu_putstr(SDSTR(pfe->filew));
+	edit_nu_putstr(file_namew(pfe));
 	for (pch = USTR(textline->line); (ch = *pch) != L'\0'; pch++)
 		if (!ISWPRINT(ch) || (lang_data.utf8 && ch == L'\xFFFD'))
 			*pch = L'_';
@@ -61,7 +61,6 @@ void
 cx_rename(void)
 {
 	const char *oldname, *newname;
-	const wchar_t *newnamew;
 	struct stat st;
 
 	if (line_tmp.size == 0) {
@@ -69,8 +68,8 @@ cx_rename(void)
 		return;
 	}
 
-	oldname = SDSTR(pfe->file);
-	newname = convert2mb(newnamew = USTR(textline->line));
+	oldname = pfe->file;
+	newname = convert2mb(USTR(textline->line));
 	if (strcmp(newname,oldname) == 0) {
 		msgout(MSG_i,"file not renamed");
 		next_mode = MODE_SPECIAL_RETURN;
@@ -90,10 +89,9 @@ cx_rename(void)
 	else {
 		msgout(MSG_AUDIT,"Rename: \"%s\" --> \"%s\" in \"%s\"",
 		  oldname,newname,USTR(ppanel_file->dir));
-		sd_copy(&pfe->file,newname);
-		sdw_copy(&pfe->filew,newnamew);
+		file_rename(pfe,newname);
 	}
-	list_directory();
+	list_directory_update();
 	win_panel();
 	next_mode = MODE_SPECIAL_RETURN;
 }
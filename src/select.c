@@ -109,7 +109,7 @@ cx_select_files(void)
 
 	for (i = cnt = 0; i < ppanel_file->pd->cnt; i++) {
 		pfe = ppanel_file->files[i];
-		if (pfe->select != mode_sel && match_pattern(SDSTR(pfe->file))) {
+		if (pfe->select != mode_sel && match_pattern(pfe->file)) {
 			pfe->select = mode_sel;
 			cnt++;
 		}
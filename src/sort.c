@@ -14,9 +14,10 @@
 
 #include "clexheaders.h"
 
+#include <ctype.h>		/* isdigit() */
 #include <wctype.h>		/* iswdigit() */
 #include <stdlib.h>		/* qsort() */
-#include <string.h>		/* strlen() */
+#include <string.h>		/* strcmp(), strxfrm(), memcpy() */
 
 /* major() */
 #ifdef MAJOR_IN_MKDEV
@@ -28,10 +29,13 @@
 
 #include "sort.h"
 
+#include "cfg.h"		/* cfg_num() */
 #include "directory.h"	/* filepos_save() */
 #include "inout.h"		/* win_panel() */
 #include "list.h"		/* file_panel_data() */
 #include "opt.h"		/* opt_changed() */
+#include "util.h"		/* emalloc() */
+#include "workers.h"	/* work_submit() */
 
 int
 sort_prepare(void)
@@ -239,73 +243,606 @@ num_wcscoll(const wchar_t *name1, const wchar_t *name2)
 	return wcscoll(name1,name2);
 }
 
+/*
+ * collation keys
+ *
+ * Comparing names with strcoll() in every qsort() step is expensive,
+ * strcoll() transforms both strings internally each time. Instead,
+ * a key is built once per entry and the names are compared with
+ * a plain strcmp() of the keys. The key is kept in the panel arena
+ * until the name changes; the locale is set only at startup and
+ * never changes later.
+ *
+ * The key for the SORT_NAME_NUM order is strxfrm() of the whole name
+ * with every run of digits rewritten to digits that collate in numeric
+ * order: the count of significant digits, the significant digits and
+ * the count of leading zeros in reverse (the same number with more
+ * leading zeros sorts first). A count is written as a digit, each
+ * leading '9' (or '0' in reverse) stands for 9 and more to follow.
+ */
+static USTRING key = UNULL;
+static size_t keylen;
+
+/* append strxfrm() of 'str' to the key */
+static void
+key_xfrm(const char *str)
+{
+	size_t len;
+
+	for (len = 0; ;) {
+		us_resize(&key,keylen + len + 1);
+		len = strxfrm(USTR(key) + keylen,str,key.USalloc - keylen);
+		if (len < key.USalloc - keylen)
+			break;
+	}
+	keylen += len;
+}
+
+static USTRING text = UNULL;
+static size_t textlen;
+
+static void
+text_addch(int ch)
+{
+	us_resize(&text,textlen + 2);
+	USTR(text)[textlen++] = (char)ch;
+}
+
+/* append the count 'n', a larger count sorts after a smaller one */
+static void
+text_addcnt(int n)
+{
+	for (; n >= 9; n -= 9)
+		text_addch('9');
+	text_addch('0' + n);
+}
+
+static void
+num_key(const char *name)
+{
+	int i, len, zeros;
+
+	for (textlen = 0; *name; name += len) {
+		if (isdigit((unsigned char)*name)) {
+			for (zeros = 0; name[zeros] == '0'; zeros++)
+				;
+			for (len = zeros; isdigit((unsigned char)name[len]); len++)
+				;
+			text_addcnt(len - zeros);
+			for (i = zeros; i < len; i++)
+				text_addch(name[i]);
+			/* leading zeros in reverse: none = "9", 8 = "1", 9 = "09" */
+			for (; zeros >= 9; zeros -= 9)
+				text_addch('0');
+			text_addch('9' - zeros);
+		}
+		else {
+			for (len = 1; name[len] && !isdigit((unsigned char)name[len]); len++)
+				;
+			us_resize(&text,textlen + len + 1);
+			memcpy(USTR(text) + textlen,name,len);
+			textlen += len;
+		}
+	}
+	text_addch('\0');
+	keylen = 0;
+	key_xfrm(USTR(text));
+}
+
+/* group rank with device numbers for the GROUP_DBCOP grouping */
+static int
+cmp_group(const FILE_ENTRY *pfe1, const FILE_ENTRY *pfe2)
+{
+	int cmp;
+
+	cmp = pfe1->grank - pfe2->grank;
+	if (cmp || (pfe1->grank != FILETYPE_BDEV && pfe1->grank != FILETYPE_CDEV))
+		return cmp;
+
+	/* special sorting for devices */
+	cmp = major(pfe1->extra->devnum) - major(pfe2->extra->devnum);
+	if (cmp)
+		return cmp;
+	return minor(pfe1->extra->devnum) - minor(pfe2->extra->devnum);
+}
+
+/*
+ * one compare function for each sort order, the file type grouping
+ * is handled by cmp_group(), the last resort is the file name
+ */
+static int
+qcmp_name(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) )
+		return cmp;
+	/* SORT_NAME_NUM: numeric comparison is built into the key */
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
+static int
+qcmp_ext(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) || (cmp = strcoll(pfe1->extension,pfe2->extension)) )
+		return cmp;
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
+static int
+qcmp_size(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) || (cmp = CMP(pfe1->size,pfe2->size)) )
+		return cmp;
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
+static int
+qcmp_size_rev(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) || (cmp = CMP(pfe2->size,pfe1->size)) )
+		return cmp;
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
+static int
+qcmp_time(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) || (cmp = CMP(pfe2->mtime,pfe1->mtime)) )
+		return cmp;
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
 static int
-qcmp(const void *e1, const void *e2)
+qcmp_time_rev(const void *e1, const void *e2)
 {
-	int cmp, gr, group1, group2;
+	int cmp;
 	FILE_ENTRY *pfe1, *pfe2;
 
 	pfe1 = (*(FILE_ENTRY **)e1);
 	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) || (cmp = CMP(pfe1->mtime,pfe2->mtime)) )
+		return cmp;
+	return strcmp(pfe1->collkey,pfe2->collkey);
+}
+
+static int
+qcmp_eman(const void *e1, const void *e2)
+{
+	int cmp;
+	FILE_ENTRY *pfe1, *pfe2;
+
+	pfe1 = (*(FILE_ENTRY **)e1);
+	pfe2 = (*(FILE_ENTRY **)e2);
+	if ( (cmp = cmp_group(pfe1,pfe2)) )
+		return cmp;
+	return revstrcmp(pfe1->file,pfe2->file);
+}
+
+/* indexed by SORT_XXX */
+static int (*qcmp_order[SORT_TOTAL_])(const void *, const void *) = {
+	qcmp_name, qcmp_name, qcmp_ext, qcmp_size,
+	qcmp_size_rev, qcmp_time, qcmp_time_rev, qcmp_eman
+};
+
+/* compare function for the current sort order, set by sort_prep() */
+static int (*qcmp)(const void *, const void *);
+
+/*
+ * prepare the entries in the 'list' for sorting: compute the group rank
+ * and make sure they have a key suitable for the current sort order
+ */
+static void
+sort_prep(FILE_ENTRY **list, int cnt)
+{
+	int i, gr, order;
+	FLAG num;
+	FILE_ENTRY *pfe;
 
-	/* I. file type grouping */
+	order = ppanel_file->order;
 	gr = ppanel_file->group;
-	if (gr != GROUP_NONE) {
-		group1 = sort_group(gr,pfe1);
-		group2 = sort_group(gr,pfe2);
-		cmp = group1 - group2;
-		if (cmp)
-			return cmp;
-
-		/* special sorting for devices */
-		if (gr == GROUP_DBCOP && (group1 == FILETYPE_BDEV || group1 == FILETYPE_CDEV) ) {
-			cmp = major(pfe1->devnum) - major(pfe2->devnum);
-			if (cmp)
-				return cmp;
-			cmp = minor(pfe1->devnum) - minor(pfe2->devnum);
-			if (cmp)
-				return cmp;
+	qcmp = qcmp_order[order];
+	num = order == SORT_NAME_NUM;
+	for (i = 0; i < cnt; i++) {
+		pfe = list[i];
+		/* file type may change, the rank is always recomputed */
+		pfe->grank = gr == GROUP_NONE ? 0 : sort_group(gr,pfe);
+		if (order == SORT_EMAN || (pfe->collkey && pfe->keynum == num))
+			continue;
+		if (num)
+			num_key(pfe->file);
+		else {
+			keylen = 0;
+			key_xfrm(pfe->file);
 		}
+		pfe->collkey = arena_strdup(&ppanel_file->arena,USTR(key));
+		pfe->keynum = num;
 	}
+}
+
+#define RADIX_MIN	1024	/* use the radix sort for lists at least this long */
+#define VAL_BYTES	sizeof(off_t)	/* time_t must not be larger, see sort_files() */
 
-	/* II. sort order */
-	switch (ppanel_file->order) {
-	case SORT_NAME_NUM:
-		cmp = num_wcscoll(SDSTR(pfe1->filew),SDSTR(pfe2->filew));
-		break;
-	case SORT_EXT:
-		cmp = strcoll(pfe1->extension,pfe2->extension);
-		break;
-	case SORT_SIZE:
-		cmp = CMP(pfe1->size,pfe2->size);
-		break;
-	case SORT_SIZE_REV:
-		cmp = CMP(pfe2->size,pfe1->size);
-		break;
-	case SORT_TIME:
-		cmp = CMP(pfe2->mtime,pfe1->mtime);
-		break;
-	case SORT_TIME_REV:
-		cmp = CMP(pfe1->mtime,pfe2->mtime);
-		break;
-	case SORT_EMAN:
-		return revstrcmp(SDSTR(pfe1->file),SDSTR(pfe2->file));
-	default:
-		/* SORT_NAME */
-		cmp = 0;
+/*
+ * sort the 'list' for one of the numeric orders (SORT_NEEDS_INFO)
+ *
+ * A stable LSD radix sort orders the entries by the size or time with
+ * the group rank as the most significant digit, one byte per pass.
+ * Passes where all entries have the same digit are skipped, that's
+ * the most of the high order bytes. The runs of equal values are then
+ * sorted by name with qsort() and so are the device groups which
+ * are ordered by device numbers first.
+ *
+ * This function runs also in the worker threads, see sort_parallel(),
+ * it uses malloc() instead of emalloc() and returns -1 if out of memory.
+ */
+static int
+radix_sort(FILE_ENTRY **list, int cnt)
+{
+	int i, j, k, d, order, *idx, *tmp, *swap, count[256];
+	size_t b;
+	FLAG rev, size;
+	off_t val;
+	unsigned char *digit;
+	FILE_ENTRY *pfe, **copy;
+
+	order = ppanel_file->order;
+	size = order == SORT_SIZE || order == SORT_SIZE_REV;
+	rev = order == SORT_SIZE_REV || order == SORT_TIME;
+
+	digit = malloc((VAL_BYTES + 1) * cnt);
+	idx = malloc(2 * cnt * sizeof(int));
+	copy = malloc(cnt * sizeof(FILE_ENTRY *));
+	if (digit == 0 || idx == 0 || copy == 0) {
+		free(digit);
+		free(idx);
+		free(copy);
+		return -1;
 	}
-	if (cmp)
-		return cmp;
 
-	/* III. sort by file name */
-	return strcoll(SDSTR(pfe1->file),SDSTR(pfe2->file));
+	/* digit[b * cnt + i] = b-th byte of the i-th entry's key */
+	for (i = 0; i < cnt; i++) {
+		pfe = list[i];
+		val = size ? pfe->size : (off_t)pfe->mtime;
+		for (b = 0; b < VAL_BYTES; b++) {
+			d = (val >> (8 * b)) & 0xFF;
+			if (b == VAL_BYTES - 1)
+				d ^= 0x80;	/* signed value */
+			digit[b * cnt + i] = rev ? 0xFF - d : d;
+		}
+		digit[VAL_BYTES * cnt + i] = pfe->grank;
+	}
+
+	tmp = idx + cnt;
+	for (i = 0; i < cnt; i++)
+		idx[i] = i;
+	for (b = 0; b <= VAL_BYTES; b++) {
+		for (d = 0; d < 256; d++)
+			count[d] = 0;
+		for (i = 0; i < cnt; i++)
+			count[digit[b * cnt + i]]++;
+		if (count[digit[b * cnt]] == cnt)
+			continue;
+		for (k = 0, d = 0; d < 256; d++) {
+			j = count[d];
+			count[d] = k;
+			k += j;
+		}
+		for (i = 0; i < cnt; i++)
+			tmp[count[digit[b * cnt + idx[i]]]++] = idx[i];
+		swap = idx;
+		idx = tmp;
+		tmp = swap;
+	}
+
+	memcpy(copy,list,cnt * sizeof(FILE_ENTRY *));
+	for (i = 0; i < cnt; i++)
+		list[i] = copy[idx[i]];
+	free(copy);
+	free(idx < tmp ? idx : tmp);
+	free(digit);
+
+	for (i = 0; i < cnt; i = j) {
+		pfe = list[i];
+		if (pfe->grank == FILETYPE_BDEV || pfe->grank == FILETYPE_CDEV)
+			for (j = i + 1; j < cnt && list[j]->grank == pfe->grank; j++)
+				;
+		else if (size)
+			for (j = i + 1; j < cnt && list[j]->grank == pfe->grank
+			  && list[j]->size == pfe->size; j++)
+				;
+		else
+			for (j = i + 1; j < cnt && list[j]->grank == pfe->grank
+			  && list[j]->mtime == pfe->mtime; j++)
+				;
+		if (j - i > 1)
+			qsort(list + i,j - i,sizeof(FILE_ENTRY *),qcmp);
+	}
+	return 0;
+}
+
+/* sort a prepared list, see sort_prep() */
+static void
+sort_list(FILE_ENTRY **list, int cnt)
+{
+	if (SORT_NEEDS_INFO(ppanel_file->order) && cnt >= RADIX_MIN
+	  && sizeof(time_t) <= sizeof(off_t) && radix_sort(list,cnt) == 0)
+		return;
+	qsort(list,cnt,sizeof(FILE_ENTRY *),qcmp);
+}
+
+#ifdef HAVE_PTHREAD_CREATE
+
+#define PSORT_MIN	100000	/* sort lists at least this long in parallel */
+
+/*
+ * parallel sort: the list is split into one chunk per worker thread,
+ * the chunks are sorted by sort_list() and then merged pairwise,
+ * the merges in each round run in parallel too
+ *
+ * The compare functions end with the file name, no two entries
+ * compare equal and the result is the same as with sort_list().
+ */
+typedef struct {
+	FILE_ENTRY **src, **dst;	/* sort 'src' or merge it into 'dst' */
+	int cnt;					/* number of entries */
+	int cnt1;					/* merge: entries in the first part */
+} SORT_JOB;
+
+static WORK_GROUP psort_group;
+
+static void
+sort_job(void *arg)
+{
+	SORT_JOB *pj;
+
+	pj = arg;
+	sort_list(pj->src,pj->cnt);
+}
+
+static void
+merge_job(void *arg)
+{
+	int i, j, k;
+	SORT_JOB *pj;
+
+	pj = arg;
+	for (i = 0, j = pj->cnt1, k = 0; i < pj->cnt1 && j < pj->cnt; k++)
+		pj->dst[k] = qcmp(pj->src + j,pj->src + i) < 0 ? pj->src[j++] : pj->src[i++];
+	while (i < pj->cnt1)
+		pj->dst[k++] = pj->src[i++];
+	while (j < pj->cnt)
+		pj->dst[k++] = pj->src[j++];
+}
+
+static void
+sort_parallel(FILE_ENTRY **list, int cnt, int chunks)
+{
+	int i, width, lo, mid, hi, *start;
+	FILE_ENTRY **src, **dst, **swap;
+	SORT_JOB *job;
+
+	job = emalloc(chunks * sizeof(SORT_JOB));
+	start = emalloc((chunks + 1) * sizeof(int));
+	for (i = 0; i <= chunks; i++)
+		start[i] = (int)((double)cnt * i / chunks);
+
+	for (i = 0; i < chunks; i++) {
+		job[i].src = list + start[i];
+		job[i].cnt = start[i + 1] - start[i];
+		work_submit(&psort_group,sort_job,job + i);
+	}
+	work_wait(&psort_group);
+
+	src = list;
+	dst = emalloc(cnt * sizeof(FILE_ENTRY *));
+	for (width = 1; width < chunks; width *= 2) {
+		for (i = 0; i < chunks; i += 2 * width) {
+			lo = start[i];
+			mid = start[i + width < chunks ? i + width : chunks];
+			hi = start[i + 2 * width < chunks ? i + 2 * width : chunks];
+			job[i].src = src + lo;
+			job[i].dst = dst + lo;
+			job[i].cnt = hi - lo;
+			job[i].cnt1 = mid - lo;
+			work_submit(&psort_group,merge_job,job + i);
+		}
+		work_wait(&psort_group);
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != list) {
+		memcpy(list,src,cnt * sizeof(FILE_ENTRY *));
+		dst = src;
+	}
+	efree(dst);
+	efree(start);
+	efree(job);
+}
+
+#endif
+
+/*
+ * The result of each sort is saved, switching back to a previously used
+ * order and grouping only copies the saved list. A saved list is valid
+ * until the panel's 'list_gen' changes.
+ */
+static FLAG
+sort_restore(SORT_SAVED *pss)
+{
+	if (pss->gen != ppanel_file->list_gen || pss->cnt != ppanel_file->all_cnt)
+		return 0;
+	memcpy(ppanel_file->all_files,pss->files,ppanel_file->all_cnt * sizeof(FILE_ENTRY *));
+	return 1;
+}
+
+static void
+sort_save(SORT_SAVED *pss)
+{
+	if (pss->alloc < ppanel_file->all_cnt || pss->alloc > ppanel_file->all_alloc) {
+		efree(pss->files);
+		pss->alloc = ppanel_file->all_alloc;
+		pss->files = emalloc(pss->alloc * sizeof(FILE_ENTRY *));
+	}
+	memcpy(pss->files,ppanel_file->all_files,ppanel_file->all_cnt * sizeof(FILE_ENTRY *));
+	pss->cnt = ppanel_file->all_cnt;
+	pss->gen = ppanel_file->list_gen;
+}
+
+/* sort a prepared list, in parallel if it is long enough */
+static void
+sort_all(FILE_ENTRY **list, int cnt)
+{
+#ifdef HAVE_PTHREAD_CREATE
+	if (cnt >= PSORT_MIN && cfg_num(CFG_WORKERS) > 1)
+		sort_parallel(list,cnt,cfg_num(CFG_WORKERS));
+	else
+#endif
+		sort_list(list,cnt);
+}
+
+/*
+ * A huge panel is sorted in two steps. At first only the TOPK_CNT
+ * leading entries are selected and sorted, that's enough to display
+ * the panel. The rest is sorted by sort_finish() before the next
+ * keystroke is processed or as soon as a not yet sorted entry is
+ * needed, see filepanel_info() and file_find().
+ */
+#define TOPK_MIN	100000	/* sort lists at least this long in two steps */
+#define TOPK_CNT	1000	/* entries sorted in the first step */
+
+/* move the 'k' leading entries (in sort order) to the beginning of the 'list' */
+static void
+select_first(FILE_ENTRY **list, int cnt, int k)
+{
+	int lo, hi, i, j;
+	FILE_ENTRY *pivot, *swap;
+
+	for (lo = 0, hi = cnt - 1; lo < hi; ) {
+		pivot = list[lo + (hi - lo) / 2];
+		for (i = lo, j = hi; i <= j; ) {
+			while (qcmp(list + i,&pivot) < 0)
+				i++;
+			while (qcmp(&pivot,list + j) < 0)
+				j--;
+			if (i <= j) {
+				swap = list[i];
+				list[i++] = list[j];
+				list[j--] = swap;
+			}
+		}
+		/* list[lo .. j] <= pivot <= list[i .. hi] */
+		if (k - 1 <= j)
+			hi = j;
+		else if (k - 1 >= i)
+			lo = i;
+		else
+			break;
+	}
 }
 
 void
 sort_files(void)
 {
-	if (ppanel_file->all_cnt == 0)
+	int i, cnt;
+	FILE_ENTRY **list;
+	SORT_SAVED *pss;
+
+	list = ppanel_file->all_files;
+	cnt = ppanel_file->all_cnt;
+	ppanel_file->partial = 0;
+	if (cnt == 0)
 		return;
-	qsort(ppanel_file->all_files,ppanel_file->all_cnt,sizeof(FILE_ENTRY *),qcmp);
+	if (SORT_NEEDS_INFO(ppanel_file->order))
+		filepanel_info_all();
+
+	if (ppanel_file->saved == 0) {
+		ppanel_file->saved = emalloc(SORT_TOTAL_ * GROUP_TOTAL_ * sizeof(SORT_SAVED));
+		for (i = 0; i < SORT_TOTAL_ * GROUP_TOTAL_; i++) {
+			ppanel_file->saved[i].gen = ppanel_file->saved[i].cnt = 0;
+			ppanel_file->saved[i].alloc = 0;
+			ppanel_file->saved[i].files = 0;
+		}
+	}
+	pss = ppanel_file->saved + ppanel_file->order * GROUP_TOTAL_ + ppanel_file->group;
+	if (!sort_restore(pss)) {
+		sort_prep(list,cnt);
+		/* the entries of a filtered panel are taken from the whole list */
+		if (cnt >= TOPK_MIN
+		  && (!ppanel_file->pd->filtering || ppanel_file->pd->filter->size == 0)) {
+			select_first(list,cnt,TOPK_CNT);
+			sort_list(list,TOPK_CNT);
+			ppanel_file->partial = TOPK_CNT;
+		}
+		else {
+			sort_all(list,cnt);
+			sort_save(pss);
+		}
+	}
 	file_panel_data();
 }
+
+/* complete the sort started by sort_files() */
+void
+sort_finish(void)
+{
+	int k;
+
+	if (ppanel_file == 0 || (k = ppanel_file->partial) == 0)
+		return;
+
+	ppanel_file->partial = 0;
+	sort_prep(ppanel_file->all_files + k,ppanel_file->all_cnt - k);
+	sort_all(ppanel_file->all_files + k,ppanel_file->all_cnt - k);
+	sort_save(ppanel_file->saved + ppanel_file->order * GROUP_TOTAL_ + ppanel_file->group);
+}
+
+/*
+ * insert 'cnt' new entries from 'list' into the already sorted list
+ * of files in the current panel; 'all_files' must have enough room
+ * and the new entries must not be pending
+ */
+void
+sort_insert(FILE_ENTRY **list, int cnt)
+{
+	int i, j, k;
+	FILE_ENTRY **all;
+
+	sort_finish();
+	/* renamed entries have lost their keys */
+	sort_prep(ppanel_file->all_files,ppanel_file->all_cnt);
+	sort_prep(list,cnt);
+	qsort(list,cnt,sizeof(FILE_ENTRY *),qcmp);
+
+	/* merge from the end, the entries before the first new one do not move */
+	all = ppanel_file->all_files;
+	i = ppanel_file->all_cnt - 1;
+	j = cnt - 1;
+	for (k = i + cnt; j >= 0; k--)
+		all[k] = i >= 0 && qcmp(all + i,list + j) > 0 ? all[i--] : list[j--];
+	ppanel_file->all_cnt += cnt;
+}
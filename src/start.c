@@ -101,6 +101,8 @@ static PANEL_DESC pd_cmp = { 1 + CMP_TOTAL_,0,0,
   EL_EXIT,PANEL_TYPE_CMP,0,el_exit,0,draw_line_cmp };
 static PANEL_DESC pd_cmp_sum = {  0,0,0,
   EL_EXIT,PANEL_TYPE_CMP_SUM,0,el_exit,0,draw_line_cmp_sum };
+static PANEL_DESC pd_cmp_tree = {  0,0,0,
+  EL_EXIT,PANEL_TYPE_CMP_TREE,0,el_exit,0,draw_line_cmp_tree };
 static PANEL_DESC pd_compl = { 0,0,0,
   EL_EXIT,PANEL_TYPE_COMPL,0,el_exit,&shared_filt,draw_line_compl };
 static PANEL_DESC pd_dir = { 0,0,0,
@@ -137,6 +139,7 @@ PANEL_CFG panel_cfg = { &pd_cfg };
 PANEL_CFG_MENU panel_cfg_menu = { &pd_cfg_menu };
 PANEL_CMP panel_cmp = { &pd_cmp };
 PANEL_CMP_SUM panel_cmp_sum = { &pd_cmp_sum };
+PANEL_CMP_TREE panel_cmp_tree = { &pd_cmp_tree };
 PANEL_DIR panel_dir = { &pd_dir };
 PANEL_DIR_SPLIT panel_dir_split = { &pd_dir_split };
 PANEL_FOPT panel_fopt = { &pd_fopt };
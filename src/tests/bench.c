@@ -0,0 +1,456 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * benchmarks of the file panel code on synthetic file lists,
+ * built only on request: make bench
+ *
+ * usage: bench [test [entries]]
+ *   reread - re-read a directory with a growing number of selected files
+ *   sort   - sort a panel in each order and grouping
+ *   substr - substring filter compared with wcsstr()
+ *   cmp    - directory compare without reading the file data
+ *
+ * The program is linked with all CLEX modules, start.c is compiled
+ * with main() renamed to clex_main(). The user interface is not
+ * initialized, HOME is set to an empty temporary directory in order
+ * to get the default configuration.
+ */
+
+#include "../clexheaders.h"
+
+#include <sys/stat.h>		/* mkdir() */
+#include <sys/time.h>		/* gettimeofday() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
+#include <ftw.h>			/* nftw() */
+#include <stdio.h>			/* printf() */
+#include <stdlib.h>			/* setenv() */
+#include <string.h>			/* strcmp() */
+#include <unistd.h>			/* chdir() */
+#include <wchar.h>			/* wcsstr() */
+#include <wctype.h>			/* towlower() */
+
+#include "../bookmarks.h"	/* bm_initialize() */
+#include "../cfg.h"			/* cfg_initialize() */
+#include "../cmp.h"			/* cmp_panels() */
+#include "../completion.h"	/* compl_initialize() */
+#include "../control.h"		/* err_exit() */
+#include "../directory.h"	/* dir_initialize() */
+#include "../exec.h"		/* exec_initialize() */
+#include "../filepanel.h"	/* files_initialize() */
+#include "../history.h"		/* hist_initialize() */
+#include "../inschar.h"		/* inschar_initialize() */
+#include "../lang.h"		/* locale_initialize() */
+#include "../list.h"		/* list_directory() */
+#include "../match.h"		/* match_substr() */
+#include "../mbwstring.h"	/* convert2w() */
+#include "../opt.h"			/* opt_initialize() */
+#include "../sort.h"		/* sort_files() */
+#include "../userdata.h"	/* userdata_initialize() */
+#include "../util.h"		/* ewcsdup() */
+
+/* the main() of this program, not clex_main() */
+#undef main
+
+static char tmpdir[] = "/tmp/clex-bench-XXXXXX";
+
+static unsigned long rnd_state = 1;
+
+static unsigned int
+rnd(unsigned int n)
+{
+	rnd_state = rnd_state * 6364136223846793005UL + 1442695040888963407UL;
+	return (unsigned int)(rnd_state >> 33) % n;
+}
+
+/* synthetic file name number 'i', the names are unique */
+static const char *
+synth_name(int i)
+{
+	static char name[64];
+	static const char *stem[] = {
+		"IMG_", "Makefile.", "README-", "backup-", "data_", "notes.",
+		"photo", "report-", "src", "test_", "x", "Zz"
+	};
+	static const char *ext[] = {
+		"", ".c", ".h", ".o", ".jpg", ".JPG", ".md", ".png", ".tar.gz", ".txt"
+	};
+
+	sprintf(name,"%s%d%s",stem[rnd(ARRAY_SIZE(stem))],i,ext[rnd(ARRAY_SIZE(ext))]);
+	return name;
+}
+
+static double
+ms_since(const struct timeval *since)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv,0);
+	return (tv.tv_sec - since->tv_sec) * 1000.0 + (tv.tv_usec - since->tv_usec) / 1000.0;
+}
+
+static int
+rm_entry(const char *path, const struct stat *pst, int type, struct FTW *pftw)
+{
+	return remove(path);
+}
+
+/* create a directory with 'cnt' empty files, return its name */
+static const char *
+synth_dir(const char *name, int cnt)
+{
+	int i, fd;
+	static char dir[sizeof(tmpdir) + 32];
+
+	sprintf(dir,"%s/%s-%d",tmpdir,name,cnt);
+	if (mkdir(dir,0755) < 0 || chdir(dir) < 0)
+		err_exit("Cannot create directory \"%s\": %s",dir,strerror(errno));
+	for (i = 0; i < cnt; i++) {
+		if ( (fd = open(synth_name(i),O_WRONLY | O_CREAT | O_EXCL,0644)) < 0)
+			err_exit("Cannot create a file in \"%s\": %s",dir,strerror(errno));
+		close(fd);
+	}
+	return dir;
+}
+
+/*
+ * fill the current panel with 'cnt' synthetic entries in random order,
+ * the panel contents is the same for the same 'seed'
+ */
+static void
+synth_panel(int cnt, unsigned long seed)
+{
+	int i, j;
+	const char *ext;
+	FILE_ENTRY *pfe;
+
+	rnd_state = seed;
+	filepanel_reset();
+	arena_reset(&ppanel_file->arena);
+	if (ppanel_file->all_alloc < cnt) {
+		ppanel_file->all_alloc = cnt;
+		ppanel_file->all_files = erealloc(ppanel_file->all_files,cnt * sizeof(FILE_ENTRY *));
+	}
+	ppanel_file->files = ppanel_file->all_files;
+	for (i = 0; i < cnt; i++) {
+		pfe = arena_alloc(&ppanel_file->arena,sizeof(FILE_ENTRY));
+		memset(pfe,0,sizeof(FILE_ENTRY));
+		pfe->file = arena_strdup(&ppanel_file->arena,synth_name(i));
+		pfe->extension = (ext = strrchr(pfe->file + 1,'.')) ? ext + 1 : "";
+		pfe->file_type = rnd(10) == 0 ? FT_DIRECTORY : rnd(50) == 0 ? FT_FIFO : FT_PLAIN_FILE;
+		pfe->size = rnd(4) == 0 ? rnd(4096) : (off_t)rnd(1U << 30);
+		pfe->mtime = 1600000000 + rnd(100000000);
+		pfe->mode12 = 0644;
+		pfe->normal_mode = 1;
+		/* shuffle */
+		j = rnd(i + 1);
+		ppanel_file->all_files[i] = ppanel_file->all_files[j];
+		ppanel_file->all_files[j] = pfe;
+	}
+	ppanel_file->all_cnt = cnt;
+	ppanel_file->pending = 0;
+	ppanel_file->list_gen++;
+	file_panel_data();
+}
+
+/*
+ * sort in each order and grouping (including the first use of the
+ * collation keys), every sort starts with the same unsorted panel
+ */
+static void
+bench_sort(int cnt)
+{
+	static const char *order[SORT_TOTAL_] = {
+		"name (numbers)", "name", "extension", "size",
+		"size (reverse)", "time", "time (reverse)", "reversed name"
+	};
+	int i, j;
+	double ms;
+	struct timeval tv;
+
+	printf("sort: %d entries\n  %-24s%12s%12s%12s\n",cnt,"[ms]","no groups","DSP","DBCOP");
+	for (i = 0; i < SORT_TOTAL_; i++) {
+		printf("  %-24s",order[i]);
+		for (j = 0; j < GROUP_TOTAL_; j++) {
+			synth_panel(cnt,1);
+			ppanel_file->order = i;
+			ppanel_file->group = j;
+			gettimeofday(&tv,0);
+			sort_files();
+			sort_finish();
+			ms = ms_since(&tv);
+			printf("%12.1f",ms);
+		}
+		putchar('\n');
+	}
+}
+
+/*
+ * substring filter: match_substr() and match_substr_lc() with the lowercase
+ * names cached (like in the file panel) compared with the former code:
+ * wcsstr() and the conversion of each name to lowercase on every use
+ */
+static void
+bench_substr(int cnt)
+{
+	static const wchar_t *substr[] = { L"x", L"img_", L".tar.gz", L"1234", L"no-match" };
+	int i, j, m, found[4];
+	double ms[4];
+	wchar_t **name, **name_lc, *sub_lc, *p, buff[64];
+	struct timeval tv;
+
+	rnd_state = 1;
+	name = emalloc(cnt * sizeof(wchar_t *));
+	name_lc = emalloc(cnt * sizeof(wchar_t *));
+	for (i = 0; i < cnt; i++) {
+		name[i] = ewcsdup(convert2w(synth_name(i)));
+		name_lc[i] = match_lowercase(ewcsdup(name[i]));
+	}
+
+	printf("substr: %d names\n  %-12s%8s%12s%14s%13s%16s%18s\n",cnt,"[ms]","matches",
+	  "wcsstr","match_substr","ignore case","wcsstr+lower","match_substr_lc");
+	for (i = 0; i < ARRAY_SIZE(substr); i++) {
+		for (m = 0; m < 4; m++)
+			found[m] = 0;
+		sub_lc = match_lowercase(ewcsdup(substr[i]));
+		panel_fopt.option[FOPT_IC] = 0;
+		match_substr_set(substr[i]);
+
+		gettimeofday(&tv,0);
+		for (j = 0; j < cnt; j++)
+			if (wcsstr(name[j],substr[i]))
+				found[0]++;
+		ms[0] = ms_since(&tv);
+
+		gettimeofday(&tv,0);
+		for (j = 0; j < cnt; j++)
+			if (match_substr(name[j]))
+				found[1]++;
+		ms[1] = ms_since(&tv);
+
+		gettimeofday(&tv,0);
+		for (j = 0; j < cnt; j++) {
+			for (p = buff; (*p = towlower(name[j][p - buff])); p++)
+				;
+			if (wcsstr(buff,sub_lc))
+				found[2]++;
+		}
+		ms[2] = ms_since(&tv);
+
+		gettimeofday(&tv,0);
+		for (j = 0; j < cnt; j++)
+			if (match_substr_lc(name_lc[j]))
+				found[3]++;
+		ms[3] = ms_since(&tv);
+
+		printf("  %-12ls%8d%12.1f%14.1f%13d%16.1f%18.1f%s\n",substr[i],found[0],
+		  ms[0],ms[1],found[2],ms[2],ms[3],
+		  found[0] != found[1] || found[2] != found[3] ? "  (results differ)" : "");
+		efree(sub_lc);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		efree(name[i]);
+		efree(name_lc[i]);
+	}
+	efree(name);
+	efree(name_lc);
+}
+
+static int
+qcmp_name(const void *e1, const void *e2)
+{
+	return strcmp((*(FILE_ENTRY **)e1)->file,(*(FILE_ENTRY **)e2)->file);
+}
+
+/* panel #2 is panel #1 with 1% files changed and 1% renamed */
+static void
+synth_panels(int cnt)
+{
+	int i;
+	FILE_ENTRY *pfe;
+
+	synth_panel(cnt,1);
+	ppanel_file = ppanel_file->other;
+	synth_panel(cnt,1);
+	for (i = 0; i < cnt; i += 50) {
+		pfe = ppanel_file->all_files[i];
+		if (i % 100)
+			pfe->file = arena_strdup(&ppanel_file->arena,synth_name(cnt + i));
+		else
+			pfe->size++;
+	}
+	ppanel_file = ppanel_file->other;
+}
+
+static double
+time_cmp(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv,0);
+	cmp_panels();
+	return ms_since(&tv);
+}
+
+/*
+ * the name matching overhead of the directory compare: cmp_panels() on
+ * unsorted panels (hash join) and on panels sorted in the C locale (merge)
+ * compared with the former code: qsort() of panel #1 and bsearch() for
+ * each file from panel #2; file sizes are compared, but not the data
+ */
+static void
+bench_cmp(int cnt)
+{
+	int i, cnt1, pairs;
+	double ms;
+	struct timeval tv;
+	PANEL_FILE *ppf2;
+	FILE_ENTRY **p1;
+
+	for (i = 0; i < CMP_TOTAL_; i++)
+		panel_cmp.option[i] = 0;
+	panel_cmp.option[CMP_REGULAR] = panel_cmp.option[CMP_SIZE] = 1;
+	synth_panels(cnt);
+	ppf2 = ppanel_file->other;
+
+	printf("cmp: %d entries in each panel\n",cnt);
+	ms = time_cmp();
+	printf("  %-24s%10.1f ms  (%d names, %d equal)\n","hash join",ms,
+	  panel_cmp_sum.names,panel_cmp_sum.equal);
+
+	gettimeofday(&tv,0);
+	p1 = emalloc(cnt * sizeof(FILE_ENTRY *));
+	for (cnt1 = i = 0; i < cnt; i++)
+		if (IS_FT_PLAIN(ppanel_file->files[i]->file_type))
+			p1[cnt1++] = ppanel_file->files[i];
+	qsort(p1,cnt1,sizeof(FILE_ENTRY *),qcmp_name);
+	for (pairs = i = 0; i < cnt; i++)
+		if (IS_FT_PLAIN(ppf2->files[i]->file_type)
+		  && bsearch(ppf2->files + i,p1,cnt1,sizeof(FILE_ENTRY *),qcmp_name))
+			pairs++;
+	ms = ms_since(&tv);
+	efree(p1);
+	printf("  %-24s%10.1f ms  (%d names)\n","qsort + bsearch",ms,pairs);
+
+	qsort(ppanel_file->all_files,cnt,sizeof(FILE_ENTRY *),qcmp_name);
+	qsort(ppf2->all_files,cnt,sizeof(FILE_ENTRY *),qcmp_name);
+	ms = time_cmp();
+	printf("  %-24s%10.1f ms  (%d names, %d equal)\n","merge (sorted panels)",ms,
+	  panel_cmp_sum.names,panel_cmp_sum.equal);
+}
+
+/*
+ * selection preserving re-read: the kept names are looked up in
+ * a hash set, the time should not depend on the number of selected
+ * files; the panel is sorted by size, because otherwise only the
+ * selected files would be stat()ed during the listing
+ */
+static void
+bench_reread(int cnt)
+{
+	static const int percent[] = { 0, 1, 10, 50, 100 };
+	int i, j, run, sel, n;
+	double ms, best;
+	struct timeval tv;
+	FILE_ENTRY *pfe;
+
+	panel_sort.order = SORT_SIZE;	/* used by changedir() */
+	changedir(synth_dir("reread",cnt));
+	printf("reread: %d files\n",cnt);
+	for (i = 0; i < ARRAY_SIZE(percent); i++) {
+		sel = (int)((double)cnt * percent[i] / 100);
+		for (n = j = 0; j < ppanel_file->all_cnt; j++) {
+			pfe = ppanel_file->all_files[j];
+			if ( (pfe->select = !pfe->dotdir && n < sel) )
+				n++;
+		}
+		ppanel_file->selected = sel;
+		ppanel_file->selected_out = 0;
+		for (best = 0, run = 0; run < 3; run++) {
+			gettimeofday(&tv,0);
+			list_directory();
+			ms = ms_since(&tv);
+			if (run == 0 || ms < best)
+				best = ms;
+		}
+		printf("  %7d selected (%3d%%): %9.1f ms%s\n",sel,percent[i],best,
+		  ppanel_file->selected == sel ? "" : "  (selection lost)");
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*fn)(int);
+	int cnt[3];		/* default list sizes, 0 = unused */
+} bench[] = {
+	{ "reread",		bench_reread,	{ 100000 } },
+	{ "sort",		bench_sort,		{ 10000, 100000, 1000000 } },
+	{ "substr",		bench_substr,	{ 1000000 } },
+	{ "cmp",		bench_cmp,		{ 1000000 } }
+};
+
+int
+main(int argc, char *argv[])
+{
+	int i, j, cnt;
+	FLAG found = 0;
+
+	if (mkdtemp(tmpdir) == 0) {
+		perror("mkdtemp");
+		return 2;
+	}
+	setenv("HOME",tmpdir,1);
+	unsetenv("XDG_CONFIG_HOME");
+	if (chdir(tmpdir) < 0) {
+		perror("chdir");
+		return 2;
+	}
+
+	locale_initialize();
+	clex_data.umask = umask(0777);
+	umask(clex_data.umask);
+	clex_data.pid = getpid();
+	sprintf(clex_data.pidstr,"%d",(int)clex_data.pid);
+	userdata_initialize();
+	cfg_initialize();
+	opt_initialize();
+	bm_initialize();
+	compl_initialize();
+	dir_initialize();
+	files_initialize();
+	exec_initialize();
+	hist_initialize();
+	inschar_initialize();
+	list_initialize();
+
+	cnt = argc > 2 ? atoi(argv[2]) : 0;
+	for (i = 0; i < ARRAY_SIZE(bench); i++) {
+		if (argc > 1 && strcmp(argv[1],bench[i].name))
+			continue;
+		found = 1;
+		if (cnt > 0)
+			bench[i].fn(cnt);
+		else
+			for (j = 0; j < ARRAY_SIZE(bench[i].cnt) && bench[i].cnt[j]; j++)
+				bench[i].fn(bench[i].cnt[j]);
+	}
+	if (!found)
+		printf("Unknown test \"%s\"\n",argv[1]);
+
+	if (chdir("/") == 0)
+		nftw(tmpdir,rm_entry,16,FTW_DEPTH | FTW_PHYS);
+	return found ? 0 : 1;
+}
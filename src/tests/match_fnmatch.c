@@ -0,0 +1,136 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * differential test: match_pattern() must return the same results
+ * as fnmatch() with the same flags (FNM_PERIOD unless FOPT_ALL)
+ *
+ * usage: match_fnmatch [iterations [seed]]
+ * exit status: 0 = ok, 1 = a difference was found
+ */
+
+#include "../clexheaders.h"
+
+#include <fnmatch.h>		/* fnmatch() */
+#include <locale.h>			/* setlocale() */
+#include <stdarg.h>			/* va_list */
+#include <stdio.h>			/* printf() */
+#include <stdlib.h>			/* exit() */
+#include <string.h>			/* strlen() */
+
+#include "../match.h"
+
+/* used by match.c and mbwstring.c */
+PANEL_FOPT panel_fopt;
+LANG_DATA lang_data;
+
+/* used by util.c */
+void
+err_exit(const char *format, ...)
+{
+	va_list argptr;
+
+	va_start(argptr,format);
+	vfprintf(stderr,format,argptr);
+	va_end(argptr);
+	fputc('\n',stderr);
+	exit(2);
+}
+
+#define REPORT_MAX	20
+
+static long checks, failures;
+
+/* compare both matchers, all characters are ASCII */
+static void
+check(const char *pattern, const char *name)
+{
+	int all, expected, result;
+	size_t i;
+	wchar_t wpattern[64];
+
+	for (i = 0; (wpattern[i] = (unsigned char)pattern[i]); i++)
+		;
+	match_pattern_set(wpattern);
+	for (all = 0; all <= 1; all++) {
+		panel_fopt.option[FOPT_ALL] = all;
+		expected = fnmatch(pattern,name,all ? 0 : FNM_PERIOD) == 0;
+		result = match_pattern(name) != 0;
+		checks++;
+		if (result != expected && ++failures <= REPORT_MAX)
+			printf("pattern \"%s\" name \"%s\"%s: fnmatch %d, match_pattern %d\n",
+			  pattern,name,all ? "" : " FNM_PERIOD",expected,result);
+	}
+}
+
+/* hand-picked cases: brackets, escapes and leading dots */
+static const char *edge_pattern[] = {
+	"", "*", "?", "**", "*?", "?*", "a*", "*a", "*a*", "a*b*c", "*.*", ".*",
+	"\\.*", "[.]*", "?*.c", "*\\", "\\", "\\*", "\\?", "\\[", "\\\\", "a\\b",
+	"[", "[a", "[]", "[]]", "[]a]", "[!]]", "[!]a]", "[^]]", "[^a]", "[!a]",
+	"[a-]", "[-a]", "[a-c]", "[!a-c]", "[\\]]", "[\\!]", "[\\-a]", "[a\\-c]",
+	"[[]", "[[]]", "[!", "[!]", "[*]", "[?]", "[.a]*", "[!.]*", "[[:alpha:]]",
+	"[[:digit:]]*", "[[=a=]]", "[[.a.]]", "a[", "a[b", "*[", "*]", "]", "a]b",
+	"*a*a*a*b", ".", "..", ".?", "?.", "a/b", "*/*", "a*/", "[/]"
+};
+static const char *edge_name[] = {
+	"", "a", "b", "c", "ab", "abc", "aab", "ba", ".", "..", ".a", ".abc",
+	"a.c", "x.c", "*", "?", "[", "]", "\\", "!", "^", "-", "a-", "[a", "a[",
+	"a]b", "aaaab", "aaaa", "a/b", "x/y", "a\\b", ".*", "[]", "1", "a1"
+};
+
+static unsigned long rnd_state;
+
+static unsigned int
+rnd(unsigned int n)
+{
+	rnd_state = rnd_state * 6364136223846793005UL + 1442695040888963407UL;
+	return (unsigned int)(rnd_state >> 33) % n;
+}
+
+static void
+random_string(char *buff, int maxlen, const char *alphabet)
+{
+	int i, len, alen;
+
+	alen = strlen(alphabet);
+	for (len = rnd(maxlen + 1), i = 0; i < len; i++)
+		buff[i] = alphabet[rnd(alen)];
+	buff[len] = '\0';
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, j;
+	long n, iterations;
+	char pattern[16], name[16];
+
+	iterations = argc > 1 ? atol(argv[1]) : 200000;
+	rnd_state = argc > 2 ? strtoul(argv[2],0,10) : 1;
+	setlocale(LC_ALL,"C");
+
+	for (i = 0; i < ARRAY_SIZE(edge_pattern); i++)
+		for (j = 0; j < ARRAY_SIZE(edge_name); j++)
+			check(edge_pattern[i],edge_name[j]);
+
+	for (n = 0; n < iterations; n++) {
+		random_string(pattern,8,"ab.*?*[]!^\\-");
+		random_string(name,8,"ab.-[]\\*");
+		check(pattern,name);
+	}
+
+	printf("%ld checks, %ld differences\n",checks,failures);
+	return failures ? 1 : 0;
+}
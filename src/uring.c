@@ -0,0 +1,307 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * batched stat() using the Linux io_uring interface
+ *
+ * All statx requests for a batch of files are submitted with a single
+ * system call and the kernel processes them concurrently. The interface
+ * is used directly via syscall(), no helper library is required.
+ * If io_uring is not supported (old kernel, disabled by the administrator,
+ * blocked by seccomp, etc.), uring_stat() returns -1 and the caller
+ * must fall back to plain stat()/lstat() calls.
+ *
+ * uring_stat() is thread-safe, each thread uses its own ring.
+ */
+
+#include "clexheaders.h"
+
+#include <sys/stat.h>		/* struct stat */
+
+#include "uring.h"
+
+#if HAVE_DECL_IORING_OP_STATX
+# include <sys/syscall.h>	/* __NR_io_uring_setup */
+# ifdef __NR_io_uring_setup
+#  define USE_URING
+# endif
+#endif
+
+#ifdef USE_URING
+
+#include <sys/mman.h>		/* mmap() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* AT_FDCWD */
+#include <stdlib.h>			/* malloc() */
+#include <string.h>			/* memset() */
+#include <unistd.h>			/* syscall() */
+#include <linux/io_uring.h>	/* struct io_uring_params */
+#ifdef HAVE_PTHREAD_CREATE
+# include <pthread.h>		/* pthread_mutex_lock() */
+#endif
+
+/* makedev() */
+#ifdef MAJOR_IN_MKDEV
+# include <sys/mkdev.h>
+#endif
+#ifdef MAJOR_IN_SYSMACROS
+# include <sys/sysmacros.h>
+#endif
+
+
+#define RING_ENTRIES	64
+
+typedef struct ring {
+	int fd;
+	/* submission queue */
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	/* completion queue */
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	struct statx stx[RING_ENTRIES];	/* statx() output buffers */
+	struct ring *next;				/* list of unused rings */
+} RING;
+
+static RING *ring_list = 0;		/* rings not in use at the moment */
+static FLAG disabled = 0;		/* io_uring not available */
+#ifdef HAVE_PTHREAD_CREATE
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+ring_lock(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+	pthread_mutex_lock(&lock);
+#endif
+}
+
+static void
+ring_unlock(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+	pthread_mutex_unlock(&lock);
+#endif
+}
+
+static RING *
+ring_create(void)
+{
+	int fd;
+	size_t sq_len, cq_len;
+	char *sq_ptr, *cq_ptr;
+	void *sqes;
+	struct io_uring_params par;
+	RING *pr;
+
+	/* called from worker threads, emalloc() must not be used here */
+	if ((pr = malloc(sizeof(RING))) == 0)
+		return 0;
+	memset(&par,0,sizeof(par));
+	fd = syscall(__NR_io_uring_setup,RING_ENTRIES,&par);
+	if (fd < 0) {
+		free(pr);
+		return 0;
+	}
+
+	sq_len = par.sq_off.array + par.sq_entries * sizeof(unsigned int);
+	cq_len = par.cq_off.cqes + par.cq_entries * sizeof(struct io_uring_cqe);
+	if (par.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_len > sq_len)
+			sq_len = cq_len;
+		cq_len = sq_len;
+	}
+	sq_ptr = mmap(0,sq_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+	if (sq_ptr == MAP_FAILED) {
+		close(fd);
+		free(pr);
+		return 0;
+	}
+	if (par.features & IORING_FEAT_SINGLE_MMAP)
+		cq_ptr = sq_ptr;
+	else {
+		cq_ptr = mmap(0,cq_len,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+		if (cq_ptr == MAP_FAILED) {
+			munmap(sq_ptr,sq_len);
+			close(fd);
+			free(pr);
+			return 0;
+		}
+	}
+	sqes = mmap(0,par.sq_entries * sizeof(struct io_uring_sqe),
+	  PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		if (cq_ptr != sq_ptr)
+			munmap(cq_ptr,cq_len);
+		munmap(sq_ptr,sq_len);
+		close(fd);
+		free(pr);
+		return 0;
+	}
+
+	/* the ring is kept until exit, no need to remember the mmap sizes */
+	pr->fd = fd;
+	pr->sq_tail  = (unsigned int *)(sq_ptr + par.sq_off.tail);
+	pr->sq_mask  = (unsigned int *)(sq_ptr + par.sq_off.ring_mask);
+	pr->sq_array = (unsigned int *)(sq_ptr + par.sq_off.array);
+	pr->sqes = sqes;
+	pr->cq_head  = (unsigned int *)(cq_ptr + par.cq_off.head);
+	pr->cq_tail  = (unsigned int *)(cq_ptr + par.cq_off.tail);
+	pr->cq_mask  = (unsigned int *)(cq_ptr + par.cq_off.ring_mask);
+	pr->cqes = (struct io_uring_cqe *)(cq_ptr + par.cq_off.cqes);
+	return pr;
+}
+
+static RING *
+ring_get(void)
+{
+	RING *pr;
+
+	ring_lock();
+	if (disabled)
+		pr = 0;
+	else if ( (pr = ring_list) )
+		ring_list = pr->next;
+	else if ((pr = ring_create()) == 0)
+		disabled = 1;
+	ring_unlock();
+
+	return pr;
+}
+
+static void
+ring_put(RING *pr)
+{
+	ring_lock();
+	pr->next = ring_list;
+	ring_list = pr;
+	ring_unlock();
+}
+
+static void
+stx2stat(const struct statx *pstx, struct stat *pst)
+{
+	memset(pst,0,sizeof(struct stat));
+	pst->st_dev   = makedev(pstx->stx_dev_major,pstx->stx_dev_minor);
+	pst->st_ino   = pstx->stx_ino;
+	pst->st_mode  = pstx->stx_mode;
+	pst->st_nlink = pstx->stx_nlink;
+	pst->st_uid   = pstx->stx_uid;
+	pst->st_gid   = pstx->stx_gid;
+	pst->st_rdev  = makedev(pstx->stx_rdev_major,pstx->stx_rdev_minor);
+	pst->st_size  = pstx->stx_size;
+	pst->st_blksize = pstx->stx_blksize;
+	pst->st_blocks  = pstx->stx_blocks;
+	pst->st_atime = pstx->stx_atime.tv_sec;
+	pst->st_mtime = pstx->stx_mtime.tv_sec;
+	pst->st_ctime = pstx->stx_ctime.tv_sec;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	pst->st_atim.tv_nsec = pstx->stx_atime.tv_nsec;
+	pst->st_mtim.tv_nsec = pstx->stx_mtime.tv_nsec;
+	pst->st_ctim.tv_nsec = pstx->stx_ctime.tv_nsec;
+#endif
+}
+
+/*
+ * stat up to RING_ENTRIES files
+ * return value: 0 = ok, -1 = io_uring does not work
+ */
+static int
+ring_stat(RING *pr, int cnt, const char * const *path, int flags,
+  struct stat *st, int *err)
+{
+	int i, res, submit, done;
+	FLAG fail;
+	unsigned int head, tail, idx;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+
+	tail = *pr->sq_tail;
+	for (i = 0; i < cnt; i++) {
+		idx = tail++ & *pr->sq_mask;
+		sqe = pr->sqes + idx;
+		memset(sqe,0,sizeof(struct io_uring_sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (unsigned long)path[i];
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (unsigned long)(pr->stx + i);
+		sqe->statx_flags = flags;
+		sqe->user_data = i;
+		pr->sq_array[idx] = idx;
+	}
+	__atomic_store_n(pr->sq_tail,tail,__ATOMIC_RELEASE);
+
+	for (fail = 0, submit = cnt, done = 0; done < cnt; ) {
+		res = syscall(__NR_io_uring_enter,pr->fd,submit,cnt - done,IORING_ENTER_GETEVENTS,0,0);
+		if (res < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			/* the submission queue is in an unknown state */
+			return -1;
+		}
+		submit -= res;
+
+		head = *pr->cq_head;
+		tail = __atomic_load_n(pr->cq_tail,__ATOMIC_ACQUIRE);
+		for (; head != tail; head++, done++) {
+			cqe = pr->cqes + (head & *pr->cq_mask);
+			i = cqe->user_data;
+			if (cqe->res == -EINVAL)
+				/* IORING_OP_STATX not supported by the kernel */
+				fail = 1;
+			else if ((err[i] = -cqe->res) == 0)
+				stx2stat(pr->stx + i,st + i);
+		}
+		__atomic_store_n(pr->cq_head,head,__ATOMIC_RELEASE);
+	}
+
+	return fail ? -1 : 0;
+}
+
+int
+uring_stat(int cnt, const char * const *path, FLAG follow, struct stat *st, int *err)
+{
+	int i, len, flags;
+	RING *pr;
+
+	if ((pr = ring_get()) == 0)
+		return -1;
+
+	flags = AT_NO_AUTOMOUNT | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+	for (i = 0; i < cnt; i += len) {
+		len = cnt - i < RING_ENTRIES ? cnt - i : RING_ENTRIES;
+		if (ring_stat(pr,len,path + i,flags,st + i,err + i) < 0) {
+			/* do not put the ring back, it might be in an inconsistent state */
+			ring_lock();
+			disabled = 1;
+			ring_unlock();
+			return -1;
+		}
+	}
+
+	ring_put(pr);
+	return 0;
+}
+
+#else
+
+int
+uring_stat(int cnt, const char * const *path, FLAG follow, struct stat *st, int *err)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1 @@
+extern int uring_stat(int, const char * const *, FLAG, struct stat *, int *);
@@ -379,6 +379,7 @@ userdata_initialize(void)
 	user_data.file_cfg = estrdup(pathname_join("config"));
 	user_data.file_opt = estrdup(pathname_join("options"));
 	user_data.file_bm  = estrdup(pathname_join("bookmarks"));
+	user_data.file_hc  = estrdup(pathname_join("hashcache"));
 
 	msgout(MSG_HEADING,0);
 }
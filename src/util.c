@@ -193,3 +193,15 @@ jshash(const wchar_t *str)
    return hash;
 }
 
+/* jshash() for multibyte strings */
+unsigned int
+strhash(const char *str)
+{
+	unsigned int hash = 1315423911;
+
+	for (; *str; str++)
+		hash ^= ((hash << 5) + (unsigned char)*str + (hash >> 2));
+
+	return hash;
+}
+
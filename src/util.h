@@ -9,3 +9,4 @@ extern void pathname_set_directory(const char *);
 extern char *pathname_join(const char *);
 extern ssize_t read_fd(int, char *, size_t);
 extern unsigned int jshash(const wchar_t *);
+extern unsigned int strhash(const char *);
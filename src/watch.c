@@ -0,0 +1,214 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * watching the file panel directories for changes (Linux inotify)
+ *
+ * Each file panel has its own inotify instance with at most one watch
+ * for its directory. A watched panel does not need to be re-read after
+ * executing a command or exchanging the panels, the queued changes are
+ * applied to the existing list instead. When the changes are not
+ * available (no inotify support, queue overflow, the directory itself
+ * was removed, etc.), watch_read() returns -1 and the caller must
+ * re-read the whole directory.
+ *
+ * inotify does not report all changes: a file being written is not
+ * reported until closed and changes made by other clients of a network
+ * filesystem are not reported at all. Network filesystems are not watched
+ * and a watched panel is still re-read after PANEL_EXPTIME, see
+ * list_directory_cond().
+ */
+
+#include "clexheaders.h"
+
+#include "watch.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#include <sys/inotify.h>	/* inotify_init1() */
+#ifdef HAVE_SYS_VFS_H
+# include <sys/vfs.h>		/* statfs() */
+#endif
+#include <errno.h>			/* errno */
+#include <unistd.h>			/* read() */
+
+/*
+ * IN_MODIFY is not watched on purpose, a file being written would
+ * produce a flood of events; the final size is reported by IN_CLOSE_WRITE
+ */
+#define WATCH_MASK	(IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE \
+  | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_ONLYDIR)
+
+static FLAG disabled = 0;	/* inotify not available */
+
+/* the buffer must be properly aligned for struct inotify_event */
+static union {
+	struct inotify_event ev;
+	char buff[4096];
+} events;
+
+#ifdef HAVE_SYS_VFS_H
+/* filesystem types (f_type values) where inotify misses remote changes */
+static const uint32_t netfs[] = {
+	0x6969,			/* NFS */
+	0x517b,			/* SMB */
+	0xff534d42,		/* CIFS */
+	0xfe534d42,		/* SMB2 */
+	0x73757245,		/* CODA */
+	0x5346414f,		/* AFS */
+	0x6b414653,		/* kAFS */
+	0x00c36400,		/* CEPH */
+	0x01021997,		/* 9P */
+	0x65735546,		/* FUSE (sshfs etc.) */
+	0x47504653,		/* GPFS */
+	0x013111a8		/* IBRIX */
+};
+
+static FLAG
+network_fs(const char *dir)
+{
+	int i;
+	struct statfs sfs;
+
+	if (statfs(dir,&sfs) < 0)
+		return 0;
+	for (i = 0; i < ARRAY_SIZE(netfs); i++)
+		if ((uint32_t)sfs.f_type == netfs[i])
+			return 1;
+	return 0;
+}
+#else
+# define network_fs(DIR)	0
+#endif
+
+/* discard all queued events */
+static void
+watch_drain(int fd)
+{
+	ssize_t len;
+
+	do
+		len = read(fd,events.buff,sizeof(events));
+	while (len > 0 || (len < 0 && errno == EINTR));
+}
+
+/*
+ * start watching the directory of the file panel 'ppf', changes occurring
+ * before this call are discarded, i.e. the directory should be listed
+ * afterwards
+ */
+void
+watch_start(PANEL_FILE *ppf)
+{
+	if (ppf->watch_fd < 0) {
+		if (disabled)
+			return;
+		if ((ppf->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+			disabled = 1;
+			return;
+		}
+	}
+
+	if (ppf->watch_wd >= 0)
+		inotify_rm_watch(ppf->watch_fd,ppf->watch_wd);
+	/* failure is not fatal, the panel will be re-read as usual */
+	ppf->watch_wd = network_fs(USTR(ppf->dir))
+	  ? -1 : inotify_add_watch(ppf->watch_fd,USTR(ppf->dir),WATCH_MASK);
+	watch_drain(ppf->watch_fd);
+}
+
+void
+watch_stop(PANEL_FILE *ppf)
+{
+	if (ppf->watch_wd >= 0) {
+		inotify_rm_watch(ppf->watch_fd,ppf->watch_wd);
+		ppf->watch_wd = -1;
+		watch_drain(ppf->watch_fd);
+	}
+}
+
+/*
+ * pass the queued changes one by one to the function 'fn' which
+ * receives a WATCH_XXX code and the file name ("." for the directory
+ * itself); 'fn' may return -1 to give up, e.g. when there are too many
+ * changes
+ *
+ * return value: 0 = ok (possibly nothing has changed),
+ * -1 = changes not available, the directory must be re-read
+ */
+int
+watch_read(PANEL_FILE *ppf, int (*fn)(int, const char *))
+{
+	int change;
+	ssize_t len;
+	const char *ptr;
+	const struct inotify_event *pev;
+
+	if (ppf->watch_wd < 0)
+		return -1;
+
+	for (;/* until return */;) {
+		if ((len = read(ppf->watch_fd,events.buff,sizeof(events))) < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN ? 0 : -1;
+		}
+		for (ptr = events.buff; ptr < events.buff + len; ptr += sizeof(struct inotify_event) + pev->len) {
+			pev = (const struct inotify_event *)ptr;
+			if (pev->mask & IN_Q_OVERFLOW)
+				return -1;
+			if (pev->wd != ppf->watch_wd)
+				/* left over from a previous watch */
+				continue;
+			if (pev->mask & IN_IGNORED) {
+				/* the watch was removed by the kernel */
+				ppf->watch_wd = -1;
+				return -1;
+			}
+			if (pev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT))
+				return -1;
+
+			if (pev->mask & (IN_CREATE | IN_MOVED_TO))
+				change = WATCH_NEW;
+			else if (pev->mask & (IN_DELETE | IN_MOVED_FROM))
+				change = WATCH_GONE;
+			else
+				change = WATCH_CHANGED;
+			if ((*fn)(change,pev->len ? pev->name : ".") < 0)
+				return -1;
+		}
+	}
+}
+
+#else
+
+void
+watch_start(PANEL_FILE *ppf)
+{
+	;
+}
+
+void
+watch_stop(PANEL_FILE *ppf)
+{
+	;
+}
+
+int
+watch_read(PANEL_FILE *ppf, int (*fn)(int, const char *))
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,8 @@
+/* watch_read() change codes */
+#define WATCH_NEW		0	/* file created or moved into the directory */
+#define WATCH_GONE		1	/* file deleted or moved away */
+#define WATCH_CHANGED	2	/* file attributes or contents changed */
+
+extern void watch_start(PANEL_FILE *);
+extern void watch_stop(PANEL_FILE *);
+extern int  watch_read(PANEL_FILE *, int (*)(int, const char *));
@@ -0,0 +1,254 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2022 Vlado Potisk
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from https://github.com/xitop/clex
+ *
+ */
+
+/*
+ * a pool of worker threads for jobs spending most of their time
+ * waiting for I/O, e.g. reading file information on a network filesystem
+ *
+ * A job must not touch any data shared with the main thread (or with
+ * other jobs) and must not call any of the user interface functions.
+ * A job may submit further jobs to its own group, work_wait() waits
+ * for them too, because the submitting job is still pending.
+ * A job must not call emalloc() or other functions which exit
+ * with err_exit() on failure (the user interface is involved).
+ * Without the thread support or when the WORKERS config variable is
+ * set to 1, the jobs are executed immediately by work_submit().
+ */
+
+#include "clexheaders.h"
+
+#ifdef HAVE_PTHREAD_CREATE
+# include <pthread.h>		/* pthread_create() */
+# include <signal.h>		/* sigfillset() */
+# include <stdarg.h>		/* log.h */
+# include <stdlib.h>		/* malloc() */
+#endif
+
+#include "workers.h"
+
+#ifdef HAVE_PTHREAD_CREATE
+# include "cfg.h"			/* cfg_num() */
+# include "log.h"			/* msgout() */
+# include "util.h"			/* emalloc() */
+#endif
+
+#ifdef HAVE_PTHREAD_CREATE
+
+typedef struct {
+	void (*fn)(void *);		/* job function ... */
+	void *arg;				/* ... and its argument */
+	WORK_GROUP *group;
+} JOB;
+
+#define JOB_ALLOC_UNIT	64
+
+static struct {
+	pthread_mutex_t lock;		/* protects everything in this structure */
+	pthread_cond_t ready;		/* a job was queued (or 'quit' was set) */
+	pthread_cond_t done;		/* all jobs in some group are finished */
+	pthread_t *thread;
+	int cnt;					/* number of running threads */
+	FLAG started;				/* threads were started (possibly unsuccessfully) */
+	FLAG quit;					/* threads should terminate */
+	JOB *queue;					/* circular buffer of waiting jobs */
+	int q_alloc, q_first, q_cnt;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void *
+worker(void *unused)
+{
+	JOB job;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;/* until break */;) {
+		while (pool.q_cnt == 0 && !pool.quit)
+			pthread_cond_wait(&pool.ready,&pool.lock);
+		if (pool.q_cnt == 0)
+			break;
+		job = pool.queue[pool.q_first];		/* struct copy */
+		pool.q_first = (pool.q_first + 1) % pool.q_alloc;
+		pool.q_cnt--;
+		pthread_mutex_unlock(&pool.lock);
+
+		(*job.fn)(job.arg);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--job.group->pending == 0)
+			pthread_cond_broadcast(&pool.done);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	return 0;
+}
+
+static void
+workers_start(void)
+{
+	int i, cnt;
+	sigset_t all, save;
+
+	pool.started = 1;
+	if ((cnt = cfg_num(CFG_WORKERS)) <= 1)
+		return;
+
+	pool.thread = emalloc(cnt * sizeof(pthread_t));
+	/* signals are delivered to the main thread only */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK,&all,&save);
+	for (i = 0; i < cnt; i++)
+		if (pthread_create(pool.thread + i,0,worker,0) != 0)
+			break;
+	pthread_sigmask(SIG_SETMASK,&save,0);
+
+	if ((pool.cnt = i) < cnt)
+		msgout(MSG_NOTICE,"WORKERS: started only %d of %d threads",i,cnt);
+}
+
+/* all jobs must be finished before calling this function */
+static void
+workers_stop(void)
+{
+	int i;
+
+	if (pool.cnt) {
+		pthread_mutex_lock(&pool.lock);
+		pool.quit = 1;
+		pthread_cond_broadcast(&pool.ready);
+		pthread_mutex_unlock(&pool.lock);
+		for (i = 0; i < pool.cnt; i++)
+			pthread_join(pool.thread[i],0);
+		pool.cnt = 0;
+		pool.quit = 0;
+	}
+	efree(pool.thread);
+	pool.thread = 0;
+	pool.started = 0;
+}
+
+/*
+ * the caller holds the lock; work_submit() may be called by a job,
+ * so emalloc() cannot be used here
+ */
+static int
+queue_grow(void)
+{
+	int i;
+	JOB *queue;
+
+	if ((queue = malloc((pool.q_alloc + JOB_ALLOC_UNIT) * sizeof(JOB))) == 0)
+		return -1;
+	for (i = 0; i < pool.q_cnt; i++)
+		queue[i] = pool.queue[(pool.q_first + i) % pool.q_alloc];
+	efree(pool.queue);
+	pool.queue = queue;
+	pool.q_alloc += JOB_ALLOC_UNIT;
+	pool.q_first = 0;
+	return 0;
+}
+
+void
+workers_reconfig(void)
+{
+	/* threads will be restarted on demand */
+	workers_stop();
+}
+
+void
+work_submit(WORK_GROUP *pwg, void (*fn)(void *), void *arg)
+{
+	JOB *pjob;
+
+	if (!pool.started)
+		workers_start();
+	if (pool.cnt == 0) {
+		(*fn)(arg);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.q_cnt == pool.q_alloc && queue_grow() < 0) {
+		/* out of memory: execute the job immediately */
+		pthread_mutex_unlock(&pool.lock);
+		(*fn)(arg);
+		return;
+	}
+	pjob = pool.queue + (pool.q_first + pool.q_cnt++) % pool.q_alloc;
+	pjob->fn = fn;
+	pjob->arg = arg;
+	pjob->group = pwg;
+	pwg->pending++;
+	pthread_cond_signal(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void
+work_wait(WORK_GROUP *pwg)
+{
+	pthread_mutex_lock(&pool.lock);
+	while (pwg->pending)
+		pthread_cond_wait(&pool.done,&pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * wait until one of the 'cnt' groups in the 'list' has no pending jobs,
+ * return its index, or -1 if the list is empty
+ */
+int
+work_wait_any(WORK_GROUP **list, int cnt)
+{
+	int i;
+
+	if (cnt == 0)
+		return -1;
+	pthread_mutex_lock(&pool.lock);
+	for (;/* until break */;) {
+		for (i = 0; i < cnt; i++)
+			if (list[i]->pending == 0)
+				break;
+		if (i < cnt)
+			break;
+		pthread_cond_wait(&pool.done,&pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return i;
+}
+
+#else
+
+void
+workers_reconfig(void)
+{
+	;
+}
+
+void
+work_submit(WORK_GROUP *pwg, void (*fn)(void *), void *arg)
+{
+	(*fn)(arg);
+}
+
+void
+work_wait(WORK_GROUP *pwg)
+{
+	;
+}
+
+int
+work_wait_any(WORK_GROUP **list, int cnt)
+{
+	return cnt ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,9 @@
+/* jobs submitted together, the submitter can wait for all of them */
+typedef struct {
+	int pending;			/* submitted, but not finished jobs */
+} WORK_GROUP;
+
+extern void workers_reconfig(void);
+extern void work_submit(WORK_GROUP *, void (*)(void *), void *);
+extern void work_wait(WORK_GROUP *);
+extern int work_wait_any(WORK_GROUP **, int);